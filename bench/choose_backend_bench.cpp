@@ -0,0 +1,91 @@
+// Microbenchmarks for the routing hot path: SharedState::choose_backend()
+// per strategy, with 1..N threads picking concurrently, plus the cost of a
+// pick racing table republishes and of a full BackendLease cycle.
+
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "shared_state.h"
+#include "strategy.h"
+
+static constexpr int kBackends = 16;
+
+// One SharedState per strategy, built by thread 0 and shared by all threads
+// of a run. Hosts are IP literals, so add_target never resolves.
+static std::unique_ptr<SharedState> make_state(const std::string& strategy) {
+    auto state = std::make_unique<SharedState>();
+    state->set_strategy(strategy);
+    for (int i = 0; i < kBackends; ++i) {
+        state->add_target("backend" + std::to_string(i), "127.0.0.1", 9000 + i);
+        state->update_target_stats("backend" + std::to_string(i), 10.0 + i * 5.0, true);
+    }
+    return state;
+}
+
+static const char* const kStrategies[] = {
+    "round_robin", "least_cpu", "adaptive", "least_connections", "peak_ewma", "consistent_hash",
+};
+
+static std::unique_ptr<SharedState> shared;
+
+static void BM_ChooseBackend(benchmark::State& st) {
+    if (st.thread_index() == 0) shared = make_state(kStrategies[st.range(0)]);
+    // google-benchmark syncs threads before the timed loop starts
+    SelectionContext selection;
+    selection.hash_key = 0x9E3779B97F4A7C15ull * static_cast<uint64_t>(st.thread_index() + 1);
+    for (auto _ : st) {
+        benchmark::DoNotOptimize(shared->choose_backend(selection));
+        ++selection.hash_key;
+    }
+    st.SetLabel(kStrategies[st.range(0)]);
+    st.SetItemsProcessed(st.iterations());
+}
+BENCHMARK(BM_ChooseBackend)->DenseRange(0, 5)->ThreadRange(1, 8)->UseRealTime();
+
+// Picks while a writer flips one backend's health as fast as it can, so
+// every pick races a table republish (and, for consistent_hash, a rebuild).
+static void BM_ChooseBackendDuringRepublish(benchmark::State& st) {
+    static std::atomic<bool> stop{false};
+    static std::thread writer;
+    if (st.thread_index() == 0) {
+        shared = make_state(kStrategies[st.range(0)]);
+        stop = false;
+        writer = std::thread([] {
+            bool healthy = false;
+            while (!stop.load(std::memory_order_relaxed)) {
+                shared->update_target_stats("backend0", 10.0, healthy);
+                healthy = !healthy;
+            }
+        });
+    }
+    SelectionContext selection;
+    for (auto _ : st) {
+        benchmark::DoNotOptimize(shared->choose_backend(selection));
+        ++selection.hash_key;
+    }
+    if (st.thread_index() == 0) {
+        stop = true;
+        writer.join();
+    }
+    st.SetLabel(kStrategies[st.range(0)]);
+    st.SetItemsProcessed(st.iterations());
+}
+BENCHMARK(BM_ChooseBackendDuringRepublish)->Arg(0)->Arg(3)->Arg(5)->ThreadRange(1, 4)->UseRealTime();
+
+// pick + open/close accounting + metrics, i.e. everything but the sockets
+static void BM_LeaseCycle(benchmark::State& st) {
+    if (st.thread_index() == 0) shared = make_state(kStrategies[st.range(0)]);
+    SelectionContext selection;
+    for (auto _ : st) {
+        BackendLease lease(*shared, shared->choose_backend(selection));
+        lease.report_bytes(64, 64);
+    }
+    st.SetLabel(kStrategies[st.range(0)]);
+    st.SetItemsProcessed(st.iterations());
+}
+BENCHMARK(BM_LeaseCycle)->Arg(0)->Arg(3)->Arg(4)->ThreadRange(1, 8)->UseRealTime();
+
+BENCHMARK_MAIN();
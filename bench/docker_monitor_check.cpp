@@ -0,0 +1,144 @@
+// DockerMonitor against a fake Docker Engine API: serves streaming
+// /containers/{name}/stats over a unix socket (chunked JSON, one sample
+// every 200ms, 25% of 2 CPUs = 50%) and a 404 for "missing", then checks
+// what DockerMonitor published to SharedState. Needs no Docker daemon.
+//
+//   docker_monitor_check [--socket /tmp/lb_fake_docker.sock]
+//
+// Exits 0 when "app" reads 50% and healthy and "missing" is marked down.
+
+#include "docker_monitor.h"
+#include "shared_state.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static std::atomic<bool> stopping{false};
+
+static bool send_all(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static void serve(int fd) {
+    std::string request;
+    char buf[4096];
+    while (request.find("\r\n\r\n") == std::string::npos) {
+        ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            ::close(fd);
+            return;
+        }
+        request.append(buf, static_cast<size_t>(n));
+    }
+
+    if (request.find("/containers/missing/") != std::string::npos) {
+        std::string body = "{\"message\":\"No such container: missing\"}\n";
+        send_all(fd, "HTTP/1.1 404 Not Found\r\nContent-Type: application/json\r\nContent-Length: "
+                     + std::to_string(body.size()) + "\r\n\r\n" + body);
+        ::close(fd);
+        return;
+    }
+
+    send_all(fd, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\n\r\n");
+    long long total = 0, system = 0;
+    while (!stopping.load()) {
+        long long prev_total = total, prev_system = system;
+        total += 250;
+        system += 1000;
+        char line[256];
+        int n = std::snprintf(line, sizeof(line),
+            "{\"cpu_stats\":{\"cpu_usage\":{\"total_usage\":%lld},\"system_cpu_usage\":%lld,\"online_cpus\":2},"
+            "\"precpu_stats\":{\"cpu_usage\":{\"total_usage\":%lld},\"system_cpu_usage\":%lld}}\n",
+            total, system, prev_total, prev_system);
+        char size[16];
+        std::snprintf(size, sizeof(size), "%x\r\n", n);
+        if (!send_all(fd, size + std::string(line, static_cast<size_t>(n)) + "\r\n")) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    ::close(fd);
+}
+
+int main(int argc, char** argv) {
+    std::string path = "/tmp/lb_fake_docker.sock";
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--socket" && i + 1 < argc) {
+            path = argv[++i];
+        } else {
+            std::cerr << "usage: docker_monitor_check [--socket PATH]\n";
+            return 2;
+        }
+    }
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    ::unlink(path.c_str());
+    if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+        || ::listen(listener, 16) < 0) {
+        std::perror("fake docker socket");
+        return 2;
+    }
+    std::vector<std::thread> handlers;
+    std::thread acceptor([&]() {
+        while (true) {
+            int fd = ::accept(listener, nullptr, nullptr);
+            if (fd < 0) return;   // listener shut down
+            handlers.emplace_back(serve, fd);
+        }
+    });
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    SharedState state;
+    state.add_target("app", "127.0.0.1", 1);
+    state.add_target("missing", "127.0.0.1", 2);
+    DockerMonitor monitor(state, 1, path);
+    monitor.start();
+
+    // A few samples arrive within the first second
+    bool ok = false;
+    double cpu = 0.0;
+    bool app_healthy = false, missing_healthy = true;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!ok && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        for (auto& t : state.snapshot()) {
+            if (t.name == "app") {
+                cpu = t.cpu_percent.load();
+                app_healthy = t.healthy.load();
+            } else {
+                missing_healthy = t.healthy.load();
+            }
+        }
+        ok = std::fabs(cpu - 50.0) < 0.01 && app_healthy && !missing_healthy;
+    }
+
+    monitor.stop();
+    stopping.store(true);
+    ::shutdown(listener, SHUT_RDWR);
+    ::close(listener);
+    acceptor.join();
+    for (auto& h : handlers) h.join();
+    ::unlink(path.c_str());
+    curl_global_cleanup();
+
+    std::cout << (ok ? "OK" : "FAIL") << ": app cpu=" << cpu << "% healthy=" << app_healthy
+              << ", missing healthy=" << missing_healthy << "\n";
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,315 @@
+// TCP load generator for custom_lb. Every request writes --size bytes and
+// waits for the same number of bytes back, so it pairs with an echo
+// mock_backend behind the balancer.
+//
+// Closed loop (default): --connections clients each keep one request in
+// flight, on a persistent connection or, with --new-conn, a fresh connection
+// per request. Measures the throughput the proxy sustains.
+//
+// Open loop (--rate R): R connections per second arrive on a fixed schedule,
+// each carrying one request, no matter how slowly earlier ones complete.
+// Latency is measured from the scheduled arrival, so a stalled proxy shows up
+// in the tail instead of silently lowering the offered load.
+//
+//   load_generator --port 8080 [--host 127.0.0.1] [--duration 10] [--size 64]
+//                  [--connections 16] [--new-conn] [--rate 0] [--threads 1]
+
+#include <boost/asio.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "metrics.h"
+
+using boost::asio::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+struct LoadOptions {
+    std::string host = "127.0.0.1";
+    unsigned short port = 0;
+    double duration_s = 10.0;
+    size_t size = 64;
+    int connections = 16;
+    bool new_conn = false;
+    double rate = 0.0;           // > 0 selects open loop
+    int threads = 1;
+    size_t max_in_flight = 10000;   // open loop: arrivals past this are dropped
+};
+
+// Per-thread results; single writer, summed after the run
+struct Stats {
+    HistogramCounts latency_us;
+    uint64_t requests = 0;
+    uint64_t connections = 0;
+    uint64_t bytes = 0;          // sent + received
+    uint64_t errors = 0;
+    uint64_t dropped = 0;
+};
+
+struct Worker {
+    boost::asio::io_context io{1};
+    tcp::endpoint endpoint;
+    const LoadOptions* options = nullptr;
+    std::vector<char> payload;
+    Clock::time_point deadline;
+    Stats stats;
+    size_t in_flight = 0;
+
+    void record(Clock::time_point since) {
+        stats.latency_us.record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - since).count()));
+        ++stats.requests;
+        stats.bytes += 2 * payload.size();
+    }
+};
+
+// One closed-loop client: request, wait for the echo, repeat until the deadline
+class ClosedClient : public std::enable_shared_from_this<ClosedClient> {
+public:
+    explicit ClosedClient(Worker& worker)
+        : worker_(worker), socket_(worker.io), retry_(worker.io), reply_(worker.payload.size()) {}
+
+    void next() {
+        if (Clock::now() >= worker_.deadline) return;
+        start_ = Clock::now();
+        if (socket_.is_open()) {
+            send();
+            return;
+        }
+        auto self = shared_from_this();
+        socket_.async_connect(worker_.endpoint, [this, self](const boost::system::error_code& ec) {
+            if (ec) {
+                fail();
+                return;
+            }
+            ++worker_.stats.connections;
+            boost::system::error_code ignored;
+            socket_.set_option(tcp::no_delay(true), ignored);
+            send();
+        });
+    }
+
+private:
+    void send() {
+        auto self = shared_from_this();
+        boost::asio::async_write(socket_, boost::asio::buffer(worker_.payload),
+            [this, self](const boost::system::error_code& ec, std::size_t) {
+                if (ec) {
+                    fail();
+                    return;
+                }
+                boost::asio::async_read(socket_, boost::asio::buffer(reply_),
+                    [this, self](const boost::system::error_code& read_ec, std::size_t) {
+                        if (read_ec) {
+                            fail();
+                            return;
+                        }
+                        worker_.record(start_);
+                        if (worker_.options->new_conn) close();
+                        next();
+                    });
+            });
+    }
+
+    // Count it, reconnect after a short pause rather than spinning
+    void fail() {
+        ++worker_.stats.errors;
+        close();
+        auto self = shared_from_this();
+        retry_.expires_after(std::chrono::milliseconds(10));
+        retry_.async_wait([this, self](const boost::system::error_code&) { next(); });
+    }
+
+    void close() {
+        boost::system::error_code ignored;
+        socket_.close(ignored);
+    }
+
+    Worker& worker_;
+    tcp::socket socket_;
+    boost::asio::steady_timer retry_;
+    std::vector<char> reply_;
+    Clock::time_point start_;
+};
+
+// One open-loop arrival: connect, one request, close
+class OneShot : public std::enable_shared_from_this<OneShot> {
+public:
+    OneShot(Worker& worker, Clock::time_point scheduled)
+        : worker_(worker), socket_(worker.io), reply_(worker.payload.size()), scheduled_(scheduled) {}
+
+    void start() {
+        ++worker_.in_flight;
+        auto self = shared_from_this();
+        socket_.async_connect(worker_.endpoint, [this, self](const boost::system::error_code& ec) {
+            if (ec) {
+                done(false);
+                return;
+            }
+            ++worker_.stats.connections;
+            boost::system::error_code ignored;
+            socket_.set_option(tcp::no_delay(true), ignored);
+            boost::asio::async_write(socket_, boost::asio::buffer(worker_.payload),
+                [this, self](const boost::system::error_code& write_ec, std::size_t) {
+                    if (write_ec) {
+                        done(false);
+                        return;
+                    }
+                    boost::asio::async_read(socket_, boost::asio::buffer(reply_),
+                        [this, self](const boost::system::error_code& read_ec, std::size_t) {
+                            done(!read_ec);
+                        });
+                });
+        });
+    }
+
+private:
+    void done(bool ok) {
+        --worker_.in_flight;
+        if (ok) worker_.record(scheduled_);
+        else ++worker_.stats.errors;
+        boost::system::error_code ignored;
+        socket_.close(ignored);
+    }
+
+    Worker& worker_;
+    tcp::socket socket_;
+    std::vector<char> reply_;
+    Clock::time_point scheduled_;
+};
+
+// Fires arrivals at a fixed interval; catches up in a burst if the loop lags
+class Arrivals : public std::enable_shared_from_this<Arrivals> {
+public:
+    Arrivals(Worker& worker, double rate)
+        : worker_(worker), timer_(worker.io),
+          interval_(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate))),
+          next_(Clock::now()) {}
+
+    void tick() {
+        Clock::time_point now = Clock::now();
+        while (next_ <= now && next_ < worker_.deadline) {
+            if (worker_.in_flight >= worker_.options->max_in_flight) {
+                ++worker_.stats.dropped;
+            } else {
+                std::make_shared<OneShot>(worker_, next_)->start();
+            }
+            next_ += interval_;
+        }
+        if (next_ >= worker_.deadline) return;
+        auto self = shared_from_this();
+        timer_.expires_at(next_);
+        timer_.async_wait([this, self](const boost::system::error_code& ec) {
+            if (!ec) tick();
+        });
+    }
+
+private:
+    Worker& worker_;
+    boost::asio::steady_timer timer_;
+    Clock::duration interval_;
+    Clock::time_point next_;
+};
+
+static void usage() {
+    std::cerr << "usage: load_generator --port N [--host H] [--duration S] [--size B]\n"
+                 "                      [--connections N] [--new-conn] [--rate R] [--threads N]\n";
+    std::exit(2);
+}
+
+int main(int argc, char** argv) {
+    LoadOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--new-conn") {
+            options.new_conn = true;
+            continue;
+        }
+        if (i + 1 >= argc) usage();
+        const char* value = argv[++i];
+        if (arg == "--host") options.host = value;
+        else if (arg == "--port") options.port = static_cast<unsigned short>(std::atoi(value));
+        else if (arg == "--duration") options.duration_s = std::atof(value);
+        else if (arg == "--size") options.size = std::max<size_t>(1, std::strtoull(value, nullptr, 10));
+        else if (arg == "--connections") options.connections = std::max(1, std::atoi(value));
+        else if (arg == "--rate") options.rate = std::atof(value);
+        else if (arg == "--threads") options.threads = std::max(1, std::atoi(value));
+        else usage();
+    }
+    if (options.port == 0) usage();
+
+    try {
+        tcp::endpoint endpoint(boost::asio::ip::make_address(options.host), options.port);
+        Clock::time_point start = Clock::now();
+        Clock::time_point deadline = start + std::chrono::duration_cast<Clock::duration>(
+                                                 std::chrono::duration<double>(options.duration_s));
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        for (int t = 0; t < options.threads; ++t) {
+            auto w = std::make_unique<Worker>();
+            w->endpoint = endpoint;
+            w->options = &options;
+            w->payload.assign(options.size, 'x');
+            w->deadline = deadline;
+            if (options.rate > 0) {
+                std::make_shared<Arrivals>(*w, options.rate / options.threads)->tick();
+            } else {
+                // spread clients over threads, first threads take the remainder
+                int clients = options.connections / options.threads + (t < options.connections % options.threads);
+                for (int c = 0; c < clients; ++c) std::make_shared<ClosedClient>(*w)->next();
+            }
+            workers.push_back(std::move(w));
+        }
+
+        // In-flight requests get a grace period past the deadline, then are abandoned
+        std::vector<std::thread> threads;
+        for (auto& w : workers) {
+            Worker* worker = w.get();
+            threads.emplace_back([worker, deadline]() { worker->io.run_until(deadline + std::chrono::seconds(5)); });
+        }
+        for (auto& t : threads) t.join();
+        // Rates are over the run itself, not the drain grace
+        double elapsed = std::chrono::duration<double>(std::min(Clock::now(), deadline) - start).count();
+
+        HistogramSnapshot latency;
+        Stats total;
+        for (auto& w : workers) {
+            latency.add(w->stats.latency_us);
+            total.requests += w->stats.requests;
+            total.connections += w->stats.connections;
+            total.bytes += w->stats.bytes;
+            total.errors += w->stats.errors;
+            total.dropped += w->stats.dropped;
+        }
+
+        std::cout << std::fixed << std::setprecision(1);
+        if (options.rate > 0) {
+            std::cout << "mode         open loop, " << options.rate << " conn/s offered\n";
+        } else {
+            std::cout << "mode         closed loop, " << options.connections << " clients, "
+                      << (options.new_conn ? "new connection per request" : "persistent connections") << "\n";
+        }
+        std::cout << "elapsed      " << elapsed << " s\n"
+                  << "connections  " << total.connections << " (" << total.connections / elapsed << "/s)\n"
+                  << "requests     " << total.requests << " (" << total.requests / elapsed << "/s)\n"
+                  << "throughput   " << total.bytes / elapsed / (1024.0 * 1024.0) << " MB/s (both directions)\n"
+                  << "latency us   p50 " << latency.percentile(0.5)
+                  << "  p90 " << latency.percentile(0.9)
+                  << "  p99 " << latency.percentile(0.99)
+                  << "  p99.9 " << latency.percentile(0.999)
+                  << "  max " << latency.percentile(1.0) << "\n"
+                  << "errors       " << total.errors << "\n";
+        if (total.dropped) std::cout << "dropped      " << total.dropped << " (in-flight limit reached)\n";
+        return total.requests > 0 ? 0 : 1;
+    } catch (const std::exception& ex) {
+        std::cerr << "[FATAL] " << ex.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,124 @@
+// Mock backend for benchmarks: a TCP server that either echoes everything
+// back (round-trip latency through custom_lb) or discards it (upload
+// throughput). Optional per-read delay simulates service time.
+//
+//   mock_backend --port 9001 [--mode echo|sink] [--threads 1] [--delay-us 0]
+
+#include <boost/asio.hpp>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+
+using boost::asio::ip::tcp;
+using reuse_port = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
+struct MockOptions {
+    unsigned short port = 0;
+    bool echo = true;
+    int threads = 1;
+    std::chrono::microseconds delay{0};
+};
+
+class MockSession : public std::enable_shared_from_this<MockSession> {
+public:
+    MockSession(tcp::socket socket, const MockOptions& options)
+        : socket_(std::move(socket)), timer_(socket_.get_executor()), options_(options) {}
+
+    void read() {
+        auto self = shared_from_this();
+        socket_.async_read_some(boost::asio::buffer(buffer_),
+            [this, self](const boost::system::error_code& ec, std::size_t length) {
+                if (ec) return;   // EOF or reset: session ends
+                if (!options_.echo) {
+                    read();
+                } else if (options_.delay.count() > 0) {
+                    timer_.expires_after(options_.delay);
+                    timer_.async_wait([this, self, length](const boost::system::error_code&) { write(length); });
+                } else {
+                    write(length);
+                }
+            });
+    }
+
+private:
+    void write(std::size_t length) {
+        auto self = shared_from_this();
+        boost::asio::async_write(socket_, boost::asio::buffer(buffer_.data(), length),
+            [this, self](const boost::system::error_code& ec, std::size_t) {
+                if (!ec) read();
+            });
+    }
+
+    tcp::socket socket_;
+    boost::asio::steady_timer timer_;
+    const MockOptions& options_;
+    std::array<char, 64 * 1024> buffer_;
+};
+
+static void accept_loop(tcp::acceptor& acceptor, const MockOptions& options) {
+    acceptor.async_accept([&acceptor, &options](const boost::system::error_code& ec, tcp::socket socket) {
+        if (!ec) {
+            boost::system::error_code ignored;
+            socket.set_option(tcp::no_delay(true), ignored);
+            std::make_shared<MockSession>(std::move(socket), options)->read();
+        }
+        accept_loop(acceptor, options);
+    });
+}
+
+static void usage() {
+    std::cerr << "usage: mock_backend --port N [--mode echo|sink] [--threads N] [--delay-us N]\n";
+    std::exit(2);
+}
+
+int main(int argc, char** argv) {
+    MockOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) usage();
+        const char* value = argv[++i];
+        if (arg == "--port") options.port = static_cast<unsigned short>(std::atoi(value));
+        else if (arg == "--mode") options.echo = std::strcmp(value, "sink") != 0;
+        else if (arg == "--threads") options.threads = std::max(1, std::atoi(value));
+        else if (arg == "--delay-us") options.delay = std::chrono::microseconds(std::atoi(value));
+        else usage();
+    }
+    if (options.port == 0) usage();
+
+    try {
+        // Same layout as custom_lb: one io_context and SO_REUSEPORT acceptor per thread
+        std::vector<std::unique_ptr<boost::asio::io_context>> contexts;
+        std::vector<std::unique_ptr<tcp::acceptor>> acceptors;
+        for (int i = 0; i < options.threads; ++i) {
+            contexts.push_back(std::make_unique<boost::asio::io_context>(1));
+            auto acceptor = std::make_unique<tcp::acceptor>(*contexts.back());
+            tcp::endpoint endpoint(tcp::v4(), options.port);
+            acceptor->open(endpoint.protocol());
+            acceptor->set_option(tcp::acceptor::reuse_address(true));
+            acceptor->set_option(reuse_port(true));
+            acceptor->bind(endpoint);
+            acceptor->listen();
+            accept_loop(*acceptor, options);
+            acceptors.push_back(std::move(acceptor));
+        }
+        std::cout << "[INFO] mock_backend " << (options.echo ? "echo" : "sink")
+                  << " on port " << options.port << " with " << options.threads << " thread(s)\n";
+
+        std::vector<std::thread> threads;
+        for (auto& ctx : contexts) {
+            boost::asio::io_context* io = ctx.get();
+            threads.emplace_back([io]() { io->run(); });
+        }
+        for (auto& t : threads) t.join();
+    } catch (const std::exception& ex) {
+        std::cerr << "[FATAL] " << ex.what() << std::endl;
+        return 1;
+    }
+}
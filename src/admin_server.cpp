@@ -0,0 +1,181 @@
+#include "admin_server.h"
+#include "http_parser.h"
+#include <array>
+#include "logger.h"
+#include <memory>
+#include <sstream>
+
+// Histogram buckets exposed to Prometheus: powers of two from 32us to ~17min.
+// Each is an exact bucket edge of the log-linear histogram, so the
+// cumulative counts are exact too.
+static constexpr int kFirstExportedExponent = 5;
+static constexpr int kLastExportedExponent = 30;
+
+static void write_histogram(std::ostringstream& out, const std::string& metric, const std::string& backend,
+                            const HistogramSnapshot& h) {
+    uint64_t cumulative = 0;
+    int exponent = kFirstExportedExponent;
+    for (int i = 0; i < Histogram::kBuckets && exponent <= kLastExportedExponent; ++i) {
+        cumulative += h.counts[i];
+        uint64_t edge = uint64_t{1} << exponent;
+        if (Histogram::upper_bound(i) == edge) {
+            out << metric << "_bucket{backend=\"" << backend << "\",le=\"" << edge / 1e6 << "\"} "
+                << cumulative << "\n";
+            ++exponent;
+        }
+    }
+    out << metric << "_bucket{backend=\"" << backend << "\",le=\"+Inf\"} " << h.count << "\n";
+    out << metric << "_sum{backend=\"" << backend << "\"} " << h.sum / 1e6 << "\n";
+    out << metric << "_count{backend=\"" << backend << "\"} " << h.count << "\n";
+}
+
+std::string format_prometheus(SharedState& state, const AdmissionController& admission) {
+    struct Row {
+        TargetInfo target;
+        BackendMetrics metrics;
+    };
+    std::vector<Row> rows;
+    for (auto& t : state.snapshot()) {
+        BackendMetrics m = state.metrics(t);
+        rows.push_back({std::move(t), std::move(m)});
+    }
+
+    std::ostringstream out;
+    auto family = [&](const char* name, const char* help, const char* type, auto value) {
+        out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+        for (auto& r : rows) out << name << "{backend=\"" << r.target.name << "\"} " << value(r) << "\n";
+    };
+
+    family("lb_backend_up", "Backend health as seen by the balancer.", "gauge",
+           [](const Row& r) { return r.target.routable() ? 1 : 0; });
+    family("lb_backend_probe_up", "Active health check verdict.", "gauge",
+           [](const Row& r) { return r.target.probe_healthy.load() ? 1 : 0; });
+    family("lb_backend_circuit_state", "Outlier detection: 0 closed, 1 ejected, 2 half-open.", "gauge",
+           [](const Row& r) { return static_cast<int>(r.target.circuit.load()); });
+    family("lb_backend_ejections", "Back-to-back ejections, the current backoff exponent.", "gauge",
+           [](const Row& r) { return r.target.ejections.load(); });
+    family("lb_backend_cpu_percent", "Last CPU sample from the load source.", "gauge",
+           [](const Row& r) { return r.target.cpu_percent.load(); });
+    family("lb_backend_active_connections", "Sessions currently open to the backend.", "gauge",
+           [](const Row& r) { return r.target.active_connections.load(); });
+    family("lb_backend_connections_total", "Sessions opened to the backend.", "counter",
+           [](const Row& r) { return r.metrics.connections; });
+    family("lb_backend_connect_failures_total", "Failed or timed out connect attempts.", "counter",
+           [](const Row& r) { return r.metrics.connect_failures; });
+
+    out << "# HELP lb_backend_bytes_total Bytes relayed, by direction.\n"
+        << "# TYPE lb_backend_bytes_total counter\n";
+    for (auto& r : rows) {
+        out << "lb_backend_bytes_total{backend=\"" << r.target.name << "\",direction=\"to_backend\"} "
+            << r.metrics.bytes_to_backend << "\n";
+        out << "lb_backend_bytes_total{backend=\"" << r.target.name << "\",direction=\"from_backend\"} "
+            << r.metrics.bytes_from_backend << "\n";
+    }
+
+    struct HistogramInfo {
+        const char* name;
+        const char* help;
+        const HistogramSnapshot BackendMetrics::*field;
+    };
+    static const HistogramInfo histograms[] = {
+        {"lb_backend_connect_seconds", "TCP connect time to the backend.", &BackendMetrics::connect_us},
+        {"lb_backend_first_byte_seconds", "Time from request to first response byte.", &BackendMetrics::first_byte_us},
+        {"lb_backend_session_seconds", "Lifetime of a backend session.", &BackendMetrics::session_us},
+    };
+    for (auto& h : histograms) {
+        out << "# HELP " << h.name << " " << h.help << "\n# TYPE " << h.name << " histogram\n";
+        for (auto& r : rows) write_histogram(out, h.name, r.target.name, r.metrics.*h.field);
+    }
+
+    out << "# HELP lb_client_connections Admitted client connections.\n"
+        << "# TYPE lb_client_connections gauge\n"
+        << "lb_client_connections " << admission.active() << "\n"
+        << "# HELP lb_pending_clients Clients waiting for a backend slot.\n"
+        << "# TYPE lb_pending_clients gauge\n"
+        << "lb_pending_clients " << admission.pending() << "\n"
+        << "# HELP lb_rejected_clients_total Clients turned away, by reason.\n"
+        << "# TYPE lb_rejected_clients_total counter\n";
+    using Reject = AdmissionController::Reject;
+    out << "lb_rejected_clients_total{reason=\"limit\"} " << admission.rejected(Reject::Limit) << "\n"
+        << "lb_rejected_clients_total{reason=\"queue_full\"} " << admission.rejected(Reject::QueueFull) << "\n"
+        << "lb_rejected_clients_total{reason=\"queue_timeout\"} " << admission.rejected(Reject::QueueTimeout)
+        << "\n";
+    return out.str();
+}
+
+// ---------------------------------------------------------------------------
+
+namespace {
+
+// One scrape: read a request head, answer, close.
+class AdminSession : public std::enable_shared_from_this<AdminSession> {
+public:
+    AdminSession(tcp::socket socket, SharedState& state, const AdmissionController& admission)
+        : socket_(std::move(socket)), state_(state), admission_(admission) {}
+
+    void start() { read(); }
+
+private:
+    void read() {
+        auto self = shared_from_this();
+        socket_.async_read_some(boost::asio::buffer(buffer_.data() + length_, buffer_.size() - length_),
+            [this, self](const boost::system::error_code& ec, std::size_t n) {
+                if (ec) return;
+                length_ += n;
+                HttpHead head;
+                auto result = parse_request_head(buffer_.data(), length_, scanned_, head);
+                if (result == ParseResult::Incomplete && length_ < buffer_.size()) {
+                    read();
+                    return;
+                }
+                if (result != ParseResult::Complete) {
+                    respond("400 Bad Request", "text/plain", "bad request\n");
+                } else if (head.method == "GET" && head.target == "/metrics") {
+                    respond("200 OK", "text/plain; version=0.0.4", format_prometheus(state_, admission_));
+                } else {
+                    respond("404 Not Found", "text/plain", "try /metrics\n");
+                }
+            });
+    }
+
+    void respond(const char* status, const char* content_type, std::string body) {
+        std::ostringstream head;
+        head << "HTTP/1.1 " << status << "\r\nContent-Type: " << content_type
+             << "\r\nContent-Length: " << body.size() << "\r\nConnection: close\r\n\r\n";
+        response_ = head.str() + body;
+        auto self = shared_from_this();
+        boost::asio::async_write(socket_, boost::asio::buffer(response_),
+            [this, self](const boost::system::error_code&, std::size_t) {
+                boost::system::error_code ignored;
+                socket_.shutdown(tcp::socket::shutdown_both, ignored);
+            });
+    }
+
+    tcp::socket socket_;
+    SharedState& state_;
+    const AdmissionController& admission_;
+    std::array<char, 8192> buffer_;
+    size_t length_ = 0;
+    size_t scanned_ = 0;
+    std::string response_;
+};
+
+}  // namespace
+
+AdminServer::AdminServer(boost::asio::io_context& io_context, short port, SharedState& state,
+                         const AdmissionController& admission)
+    : io_context_(io_context),
+      acceptor_(io_context, tcp::endpoint(boost::asio::ip::address_v4::loopback(), port)),
+      state_(state),
+      admission_(admission) {}
+
+void AdminServer::start_accept() {
+    acceptor_.async_accept(io_context_, [this](const boost::system::error_code& ec, tcp::socket socket) {
+        if (!ec) {
+            std::make_shared<AdminSession>(std::move(socket), state_, admission_)->start();
+        } else {
+            LOG_ERROR("Admin accept failed: %s", ec.message().c_str());
+        }
+        start_accept();
+    });
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <string>
+
+#include "shared_state.h"
+#include "admission.h"
+
+using boost::asio::ip::tcp;
+
+// Per-backend and admission metrics in the Prometheus text exposition format
+std::string format_prometheus(SharedState& state, const AdmissionController& admission);
+
+// Local stats endpoint: GET /metrics on 127.0.0.1:<admin_port>. Runs on its
+// own io_context so scrapes never share a thread with the data plane; the
+// counters are summed at scrape time (see MetricsRegistry::collect).
+class AdminServer {
+public:
+    AdminServer(boost::asio::io_context& io_context, short port, SharedState& state,
+                const AdmissionController& admission);
+    void start_accept();
+
+private:
+    boost::asio::io_context& io_context_;
+    tcp::acceptor acceptor_;
+    SharedState& state_;
+    const AdmissionController& admission_;
+};
@@ -0,0 +1,42 @@
+#include "admission.h"
+
+AdmissionTicket& AdmissionTicket::operator=(AdmissionTicket&& other) noexcept {
+    if (this != &other) {
+        release();
+        controller_ = other.controller_;
+        other.controller_ = nullptr;
+    }
+    return *this;
+}
+
+void AdmissionTicket::release() {
+    if (controller_) controller_->active_.fetch_sub(1, std::memory_order_relaxed);
+    controller_ = nullptr;
+}
+
+void AdmissionController::set_options(const AdmissionOptions& options) {
+    max_connections_.store(options.max_connections, std::memory_order_relaxed);
+    max_pending_.store(static_cast<int>(options.max_pending), std::memory_order_relaxed);
+    pending_timeout_ms_.store(options.pending_timeout.count(), std::memory_order_relaxed);
+}
+
+AdmissionTicket AdmissionController::admit() {
+    int limit = max_connections_.load(std::memory_order_relaxed);
+    int active = active_.fetch_add(1, std::memory_order_relaxed);
+    if (limit > 0 && active >= limit) {
+        active_.fetch_sub(1, std::memory_order_relaxed);
+        count_reject(Reject::Limit);
+        return AdmissionTicket();
+    }
+    return AdmissionTicket(this);
+}
+
+bool AdmissionController::try_enqueue() {
+    int pending = pending_.fetch_add(1, std::memory_order_relaxed);
+    if (pending >= max_pending_.load(std::memory_order_relaxed)) {
+        pending_.fetch_sub(1, std::memory_order_relaxed);
+        count_reject(Reject::QueueFull);
+        return false;
+    }
+    return true;
+}
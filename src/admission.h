@@ -0,0 +1,82 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Overload limits. All of them can be changed by a reload.
+struct AdmissionOptions {
+    int max_connections = 0;               // client connections, all workers; 0 = unlimited
+    int max_connections_per_backend = 0;   // sessions + connects in flight; 0 = unlimited
+    size_t max_pending = 128;              // L4 clients waiting for a backend slot
+    std::chrono::milliseconds pending_timeout{1000};
+};
+
+class AdmissionController;
+
+// One admitted client connection; gives its slot back when released or
+// destroyed. Held by the session for the life of the client connection.
+class AdmissionTicket {
+public:
+    AdmissionTicket() = default;
+    explicit AdmissionTicket(AdmissionController* controller) : controller_(controller) {}
+    ~AdmissionTicket() { release(); }
+
+    AdmissionTicket(AdmissionTicket&& other) noexcept : controller_(other.controller_) {
+        other.controller_ = nullptr;
+    }
+    AdmissionTicket& operator=(AdmissionTicket&& other) noexcept;
+    AdmissionTicket(const AdmissionTicket&) = delete;
+    AdmissionTicket& operator=(const AdmissionTicket&) = delete;
+
+    explicit operator bool() const { return controller_ != nullptr; }
+    void release();
+
+private:
+    AdmissionController* controller_ = nullptr;
+};
+
+// Process-wide admission state shared by the workers: the global connection
+// limit, the pending-queue budget and rejection counters. Everything is a
+// relaxed atomic; the accept path does one fetch_add.
+class AdmissionController {
+public:
+    enum class Reject {
+        Limit,          // max_connections reached
+        QueueFull,      // no backend slot and max_pending reached
+        QueueTimeout,   // waited pending_timeout for a backend slot
+        Count
+    };
+
+    explicit AdmissionController(const AdmissionOptions& options = {}) { set_options(options); }
+
+    void set_options(const AdmissionOptions& options);
+
+    // A ticket for a new client connection, or an empty one at the limit
+    AdmissionTicket admit();
+
+    // Reserve / give back a place in the pending queue
+    bool try_enqueue();
+    void dequeue() { pending_.fetch_sub(1, std::memory_order_relaxed); }
+
+    void count_reject(Reject reason) { rejected_[static_cast<int>(reason)].fetch_add(1, std::memory_order_relaxed); }
+
+    std::chrono::milliseconds pending_timeout() const {
+        return std::chrono::milliseconds(pending_timeout_ms_.load(std::memory_order_relaxed));
+    }
+    int active() const { return active_.load(std::memory_order_relaxed); }
+    int pending() const { return pending_.load(std::memory_order_relaxed); }
+    uint64_t rejected(Reject reason) const {
+        return rejected_[static_cast<int>(reason)].load(std::memory_order_relaxed);
+    }
+
+private:
+    friend class AdmissionTicket;
+
+    std::atomic<int> max_connections_{0};
+    std::atomic<int> max_pending_{0};
+    std::atomic<int64_t> pending_timeout_ms_{0};
+    std::atomic<int> active_{0};
+    std::atomic<int> pending_{0};
+    std::atomic<uint64_t> rejected_[static_cast<int>(Reject::Count)] = {};
+};
@@ -0,0 +1,79 @@
+#include "backend_connector.h"
+#include "logger.h"
+
+void BackendConnector::connect(boost::asio::io_context& io_context, SharedState& state,
+                               const ConnectOptions& options, const SelectionContext& selection,
+                               Handler handler, BackendHandle preferred) {
+    std::make_shared<BackendConnector>(io_context, state, options, selection, std::move(handler),
+                                       std::move(preferred))->attempt();
+}
+
+BackendConnector::BackendConnector(boost::asio::io_context& io_context, SharedState& state,
+                                   const ConnectOptions& options, const SelectionContext& selection,
+                                   Handler handler, BackendHandle preferred)
+    : io_context_(io_context),
+      state_(state),
+      options_(options),
+      selection_(selection),
+      handler_(std::move(handler)),
+      socket_(io_context),
+      timer_(io_context),
+      backend_(std::move(preferred)) {}
+
+void BackendConnector::attempt() {
+    BackendHandle next = attempts_ == 0 && backend_ ? backend_ : state_.choose_backend(selection_);
+    if (!next) {
+        // nothing left to try: either every candidate failed or none was healthy
+        fail(backend_ ? boost::asio::error::make_error_code(boost::asio::error::host_unreachable)
+                      : boost::asio::error::make_error_code(boost::asio::error::not_found));
+        return;
+    }
+    backend_ = std::move(next);
+    backend_->connecting.fetch_add(1, std::memory_order_relaxed);   // counts against its limit
+    ++attempts_;
+    timed_out_ = false;
+    attempt_start_ = std::chrono::steady_clock::now();
+
+    auto self = shared_from_this();
+    timer_.expires_after(options_.timeout);
+    // A deadline that fired just as its connect completed can still be queued
+    // when the next attempt starts; `attempt` tells it that it is stale
+    timer_.async_wait([this, self, attempt = attempts_](const boost::system::error_code& ec) {
+        if (ec || attempt != attempts_) return;   // cancelled, or an earlier attempt's deadline
+        timed_out_ = true;
+        boost::system::error_code ignored;
+        socket_.close(ignored);
+    });
+    socket_.async_connect(backend_->endpoint, [this, self](const boost::system::error_code& ec) {
+        on_connect(ec);
+    });
+}
+
+void BackendConnector::on_connect(const boost::system::error_code& ec) {
+    timer_.cancel();
+    backend_->connecting.fetch_sub(1, std::memory_order_relaxed);
+    if (!ec && !timed_out_) {
+        state_.report_latency(*backend_, LatencyKind::Connect,
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - attempt_start_));
+        handler_({}, std::move(socket_), std::move(backend_));
+        return;
+    }
+
+    state_.report_connect_failure(*backend_);
+    boost::system::error_code reason = timed_out_ ? boost::asio::error::make_error_code(boost::asio::error::timed_out) : ec;
+    LOG_WARN("Connect to %s:%d failed (%s)", backend_->host.c_str(), backend_->port, reason.message().c_str());
+
+    boost::system::error_code ignored;
+    socket_.close(ignored);
+    if (attempts_ >= options_.max_attempts) {
+        fail(reason);
+        return;
+    }
+    selection_.exclude(backend_.get());
+    attempt();
+}
+
+void BackendConnector::fail(const boost::system::error_code& ec) {
+    handler_(ec, tcp::socket(io_context_), std::move(backend_));
+}
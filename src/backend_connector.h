@@ -0,0 +1,52 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <chrono>
+#include <functional>
+#include <memory>
+
+#include "shared_state.h"
+
+using boost::asio::ip::tcp;
+
+struct ConnectOptions {
+    std::chrono::milliseconds timeout{2000};   // per attempt
+    int max_attempts = 3;                      // backends tried before giving up
+};
+
+// Asynchronously connects to a backend chosen by SharedState. Each attempt
+// is bounded by a deadline timer; on failure or timeout the backend is
+// excluded and the next candidate from choose_backend() is tried, so a dead
+// backend costs one timeout instead of stalling the worker thread.
+class BackendConnector : public std::enable_shared_from_this<BackendConnector> {
+public:
+    // ec is set when no attempt succeeded; backend is the last one tried
+    // (nullptr if none was available).
+    using Handler = std::function<void(const boost::system::error_code& ec,
+                                       tcp::socket socket, BackendHandle backend)>;
+
+    // If `preferred` is set it is tried first instead of asking choose_backend().
+    static void connect(boost::asio::io_context& io_context, SharedState& state,
+                        const ConnectOptions& options, const SelectionContext& selection,
+                        Handler handler, BackendHandle preferred = nullptr);
+
+    BackendConnector(boost::asio::io_context& io_context, SharedState& state,
+                     const ConnectOptions& options, const SelectionContext& selection,
+                     Handler handler, BackendHandle preferred = nullptr);
+
+private:
+    void attempt();
+    void on_connect(const boost::system::error_code& ec);
+    void fail(const boost::system::error_code& ec);
+
+    boost::asio::io_context& io_context_;
+    SharedState& state_;
+    ConnectOptions options_;
+    SelectionContext selection_;
+    Handler handler_;
+    tcp::socket socket_;
+    boost::asio::steady_timer timer_;
+    BackendHandle backend_;
+    std::chrono::steady_clock::time_point attempt_start_;
+    int attempts_ = 0;
+    bool timed_out_ = false;
+};
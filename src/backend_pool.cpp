@@ -0,0 +1,61 @@
+#include "backend_pool.h"
+#include <cerrno>
+#include <sys/socket.h>
+
+// An idle HTTP connection must have nothing to read: EOF means the backend
+// closed it, and unsolicited bytes mean it is out of sync.
+static bool still_open(tcp::socket& socket) {
+    char byte;
+    ssize_t n = ::recv(socket.native_handle(), &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+BackendPool::BackendPool(const PoolOptions& options) : options_(options) {}
+
+std::optional<tcp::socket> BackendPool::acquire(const BackendHandle& backend) {
+    auto it = entries_.find(backend.get());
+    if (it == entries_.end()) return std::nullopt;
+
+    auto& idle = it->second.idle;
+    auto now = std::chrono::steady_clock::now();
+    while (!idle.empty()) {
+        Idle candidate = std::move(idle.back());
+        idle.pop_back();
+        if (now - candidate.since < options_.idle_timeout && still_open(candidate.socket))
+            return std::move(candidate.socket);
+        boost::system::error_code ignored;
+        candidate.socket.close(ignored);
+    }
+    return std::nullopt;
+}
+
+void BackendPool::sweep() {
+    auto now = std::chrono::steady_clock::now();
+    boost::system::error_code ignored;
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        auto& idle = it->second.idle;
+        bool retired = it->second.backend->retired.load(std::memory_order_relaxed);
+        // oldest first: stop at the first connection that is still fresh
+        size_t expired = 0;
+        while (expired < idle.size() && (retired || now - idle[expired].since >= options_.idle_timeout)) {
+            idle[expired].socket.close(ignored);
+            ++expired;
+        }
+        idle.erase(idle.begin(), idle.begin() + expired);
+        if (idle.empty()) it = entries_.erase(it);
+        else ++it;
+    }
+}
+
+void BackendPool::release(const BackendHandle& backend, tcp::socket socket) {
+    auto& entry = entries_[backend.get()];
+    if (!entry.backend) entry.backend = backend;
+
+    boost::system::error_code ignored;
+    if (entry.idle.size() >= options_.max_idle_per_backend) {
+        // drop the oldest; the front is the least recently used
+        entry.idle.front().socket.close(ignored);
+        entry.idle.erase(entry.idle.begin());
+    }
+    entry.idle.push_back({std::move(socket), std::chrono::steady_clock::now()});
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <chrono>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "shared_state.h"
+
+using boost::asio::ip::tcp;
+
+struct PoolOptions {
+    size_t max_idle_per_backend = 32;
+    std::chrono::milliseconds idle_timeout{30000};
+};
+
+// Idle keep-alive backend connections for the L7 mode. One pool per worker
+// thread (sockets belong to that worker's io_context), so no locking.
+class BackendPool {
+public:
+    explicit BackendPool(const PoolOptions& options);
+
+    // Most recently used idle connection to `backend` that is still open
+    std::optional<tcp::socket> acquire(const BackendHandle& backend);
+
+    // Park a connection whose last response left it reusable
+    void release(const BackendHandle& backend, tcp::socket socket);
+
+    // Close connections past idle_timeout and everything pooled for retired
+    // backends, so a drained backend is not kept alive by idle sockets
+    void sweep();
+
+private:
+    struct Idle {
+        tcp::socket socket;
+        std::chrono::steady_clock::time_point since;
+    };
+
+    struct Entry {
+        BackendHandle backend;   // keeps the key alive
+        std::vector<Idle> idle;
+    };
+
+    PoolOptions options_;
+    std::unordered_map<const TargetInfo*, Entry> entries_;
+};
@@ -0,0 +1,152 @@
+#include "cgroup_monitor.h"
+#include "logger.h"
+#include <set>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Read a small sysfs file from offset 0 into buf (NUL-terminated)
+static bool read_file(int fd, char* buf, size_t size) {
+    ssize_t n = pread(fd, buf, size - 1, 0);
+    if (n < 0) return false;
+    buf[n] = '\0';
+    return true;
+}
+
+// Find "<key> <value>" (cpu.stat) or "<key>=<value>" (PSI) in buf
+static bool find_u64(const char* buf, const char* key, std::uint64_t& value) {
+    size_t len = std::strlen(key);
+    for (const char* p = std::strstr(buf, key); p; p = std::strstr(p + 1, key)) {
+        bool at_start = p == buf || p[-1] == '\n' || p[-1] == ' ';
+        char sep = p[len];
+        if (at_start && (sep == ' ' || sep == '=')) {
+            value = std::strtoull(p + len + 1, nullptr, 10);
+            return true;
+        }
+    }
+    return false;
+}
+
+CgroupMonitor::CgroupMonitor(SharedState& state, std::chrono::milliseconds interval,
+                             std::string cgroup_root)
+    : state_(state), interval_(interval), cgroup_root_(std::move(cgroup_root)) {}
+
+CgroupMonitor::~CgroupMonitor() {
+    stop();
+}
+
+void CgroupMonitor::start() {
+    running_.store(true);
+    worker_ = std::thread(&CgroupMonitor::run_loop, this);
+}
+
+void CgroupMonitor::stop() {
+    running_.store(false);
+    if (worker_.joinable()) worker_.join();
+}
+
+std::string CgroupMonitor::cgroup_dir(const TargetInfo& target) const {
+    if (target.cgroup_path.empty()) return cgroup_root_ + "/" + target.name;
+    if (target.cgroup_path.front() == '/') return target.cgroup_path;
+    return cgroup_root_ + "/" + target.cgroup_path;
+}
+
+bool CgroupMonitor::open_files(Sampler& sampler) {
+    sampler.cpu_stat_fd = ::open((sampler.path + "/cpu.stat").c_str(), O_RDONLY | O_CLOEXEC);
+    sampler.memory_fd = ::open((sampler.path + "/memory.current").c_str(), O_RDONLY | O_CLOEXEC);
+    sampler.pressure_fd = ::open((sampler.path + "/cpu.pressure").c_str(), O_RDONLY | O_CLOEXEC);
+    sampler.primed = false;
+    if (sampler.cpu_stat_fd < 0 || sampler.memory_fd < 0) {
+        close_files(sampler);
+        return false;
+    }
+    return true;
+}
+
+void CgroupMonitor::close_files(Sampler& sampler) {
+    for (int* fd : {&sampler.cpu_stat_fd, &sampler.memory_fd, &sampler.pressure_fd}) {
+        if (*fd >= 0) ::close(*fd);
+        *fd = -1;
+    }
+    sampler.primed = false;
+}
+
+void CgroupMonitor::sample(const TargetInfo& target, Sampler& sampler) {
+    if (sampler.cpu_stat_fd < 0 && !open_files(sampler)) {
+        state_.update_target_stats(target.name, 0.0, false);
+        return;
+    }
+
+    char buf[1024];
+    std::uint64_t usage_usec = 0;
+    std::uint64_t memory_bytes = 0;
+    std::uint64_t stall_usec = 0;
+    auto now = std::chrono::steady_clock::now();
+
+    // A removed cgroup makes reads on the old fds fail (ENODEV)
+    if (!read_file(sampler.cpu_stat_fd, buf, sizeof(buf)) || !find_u64(buf, "usage_usec", usage_usec) ||
+        !read_file(sampler.memory_fd, buf, sizeof(buf))) {
+        LOG_ERROR("Monitor: cgroup %s unreadable", sampler.path.c_str());
+        close_files(sampler);
+        state_.update_target_stats(target.name, 0.0, false);
+        return;
+    }
+    memory_bytes = std::strtoull(buf, nullptr, 10);
+    bool have_pressure = sampler.pressure_fd >= 0 && read_file(sampler.pressure_fd, buf, sizeof(buf))
+                      && find_u64(buf, "total", stall_usec);   // first line is "some"
+
+    if (sampler.primed) {
+        double elapsed_usec = std::chrono::duration<double, std::micro>(now - sampler.last_sample).count();
+        if (elapsed_usec > 0.0) {
+            double cpu = (usage_usec - sampler.last_usage_usec) / elapsed_usec * 100.0;
+            double pressure = have_pressure
+                ? (stall_usec - sampler.last_stall_usec) / elapsed_usec * 100.0 : 0.0;
+            state_.update_target_stats(target.name, cpu, true);
+            state_.update_target_resources(target.name, memory_bytes, pressure);
+        }
+    }
+
+    sampler.primed = true;
+    sampler.last_usage_usec = usage_usec;
+    sampler.last_stall_usec = stall_usec;
+    sampler.last_sample = now;
+}
+
+// Background thread loop
+void CgroupMonitor::run_loop() {
+    auto next = std::chrono::steady_clock::now();
+    while (running_.load()) {
+        try {
+            std::set<std::string> names;
+            for (auto& t : state_.snapshot()) {
+                names.insert(t.name);
+                Sampler& sampler = samplers_[t.name];
+                std::string path = cgroup_dir(t);
+                if (sampler.path != path) {
+                    close_files(sampler);
+                    sampler.path = path;
+                }
+                sample(t, sampler);
+            }
+            for (auto it = samplers_.begin(); it != samplers_.end();) {
+                if (names.count(it->first)) {
+                    ++it;
+                    continue;
+                }
+                close_files(it->second);
+                it = samplers_.erase(it);
+            }
+        } catch (const std::exception& e) {
+            LOG_ERROR("Monitor: %s", e.what());
+        }
+
+        next += interval_;
+        auto now = std::chrono::steady_clock::now();
+        if (next < now) next = now;   // fell behind: don't burst to catch up
+        std::this_thread::sleep_until(next);
+    }
+
+    for (auto& [name, sampler] : samplers_) close_files(sampler);
+    samplers_.clear();
+}
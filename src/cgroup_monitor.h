@@ -0,0 +1,52 @@
+#pragma once
+#include "shared_state.h"
+#include "load_source.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <thread>
+
+// Samples each target's cgroup v2 files directly: cpu.stat (usage_usec),
+// memory.current and cpu.pressure (PSI). The files stay open between samples
+// and are re-read with pread(), so one sweep costs a handful of syscalls and
+// can run at sub-second intervals. CPU% and stall% are computed from deltas
+// between consecutive samples.
+//
+// A target's cgroup is its configured cgroup_path (relative paths are taken
+// from cgroup_root), or cgroup_root/<name> when none is set.
+class CgroupMonitor : public LoadSource {
+public:
+    CgroupMonitor(SharedState& state, std::chrono::milliseconds interval,
+                  std::string cgroup_root = "/sys/fs/cgroup");
+    ~CgroupMonitor() override;
+
+    void start() override;
+    void stop() override;
+
+private:
+    struct Sampler {
+        std::string path;
+        int cpu_stat_fd = -1;
+        int memory_fd = -1;
+        int pressure_fd = -1;                  // optional: PSI may be disabled
+        bool primed = false;                   // have a previous sample
+        std::uint64_t last_usage_usec = 0;
+        std::uint64_t last_stall_usec = 0;
+        std::chrono::steady_clock::time_point last_sample{};
+    };
+
+    void run_loop();
+    void sample(const TargetInfo& target, Sampler& sampler);
+    bool open_files(Sampler& sampler);
+    void close_files(Sampler& sampler);
+    std::string cgroup_dir(const TargetInfo& target) const;
+
+    SharedState& state_;
+    std::chrono::milliseconds interval_;
+    std::string cgroup_root_;
+    std::atomic<bool> running_{false};
+    std::thread worker_;
+    std::map<std::string, Sampler> samplers_;   // monitor thread only
+};
@@ -0,0 +1,124 @@
+#include "config.h"
+#include <yaml-cpp/yaml.h>
+#include <algorithm>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+LbConfig load_config(const std::string& path) {
+    YAML::Node config = YAML::LoadFile(path);
+    LbConfig c;
+
+    c.listen_port = config["listen_port"].as<int>();
+    c.monitor_interval = config["monitor_interval_seconds"].as<int>();
+    if (c.monitor_interval <= 0) throw std::invalid_argument("monitor_interval_seconds must be positive");
+    if (config["strategy"]) c.strategy = config["strategy"].as<std::string>();
+    // 0 (or unset) means one worker per hardware thread
+    if (config["worker_threads"]) c.worker_threads = config["worker_threads"].as<int>();
+    if (c.worker_threads <= 0)
+        c.worker_threads = std::max(1u, std::thread::hardware_concurrency());
+    if (config["admin_port"]) c.admin_port = config["admin_port"].as<int>();
+
+    if (config["proxy_mode"])
+        c.proxy.mode = parse_proxy_mode(config["proxy_mode"].as<std::string>());
+    if (config["io_backend"])
+        c.proxy.io_backend = parse_io_backend(config["io_backend"].as<std::string>());
+    if (config["relay_mode"])
+        c.proxy.relay_mode = parse_relay_mode(config["relay_mode"].as<std::string>());
+    if (config["hash_key"])
+        c.proxy.hash_key = parse_hash_key(config["hash_key"].as<std::string>());
+    if (config["connect_timeout_ms"])
+        c.proxy.connect.timeout = std::chrono::milliseconds(config["connect_timeout_ms"].as<int>());
+    if (c.proxy.connect.timeout.count() <= 0) throw std::invalid_argument("connect_timeout_ms must be positive");
+    if (config["connect_attempts"])
+        c.proxy.connect.max_attempts = std::max(1, config["connect_attempts"].as<int>());
+    if (config["pool_max_idle_per_backend"])
+        c.proxy.pool.max_idle_per_backend = config["pool_max_idle_per_backend"].as<size_t>();
+    if (config["pool_idle_timeout_ms"])
+        c.proxy.pool.idle_timeout = std::chrono::milliseconds(config["pool_idle_timeout_ms"].as<int>());
+    if (c.proxy.pool.idle_timeout.count() <= 0) throw std::invalid_argument("pool_idle_timeout_ms must be positive");
+
+    if (config["peak_ewma_decay_ms"])
+        c.strategy_options.peak_ewma_decay = std::chrono::milliseconds(config["peak_ewma_decay_ms"].as<int>());
+    if (config["maglev_table_size"])
+        c.strategy_options.maglev_table_size = config["maglev_table_size"].as<uint32_t>();
+    // validate now rather than halfway through applying a reload
+    make_strategy(c.strategy, c.strategy_options);
+    if (config["ewma_alpha"]) c.ewma_alpha = config["ewma_alpha"].as<double>();
+    if (!(c.ewma_alpha > 0.0 && c.ewma_alpha <= 1.0)) throw std::invalid_argument("ewma_alpha must be in (0, 1]");
+
+    // Load source: Docker Engine API (default), cgroup v2 files or none
+    if (config["load_source"]) c.load_source = config["load_source"].as<std::string>();
+    if (c.load_source != "docker" && c.load_source != "cgroup" && c.load_source != "none")
+        throw std::invalid_argument("unknown load_source: " + c.load_source);
+    if (config["docker_socket"]) c.docker_socket = config["docker_socket"].as<std::string>();
+    if (config["cgroup_root"]) c.cgroup_root = config["cgroup_root"].as<std::string>();
+    if (config["cgroup_sample_ms"]) c.cgroup_sample_ms = config["cgroup_sample_ms"].as<int>();
+    if (c.cgroup_sample_ms <= 0) throw std::invalid_argument("cgroup_sample_ms must be positive");
+
+    if (config["health_check"])
+        c.health_check.type = parse_health_check_type(config["health_check"].as<std::string>());
+    if (config["health_check_interval_ms"])
+        c.health_check.interval = std::chrono::milliseconds(config["health_check_interval_ms"].as<int>());
+    if (config["health_check_timeout_ms"])
+        c.health_check.timeout = std::chrono::milliseconds(config["health_check_timeout_ms"].as<int>());
+    if (config["health_check_path"]) c.health_check.http_path = config["health_check_path"].as<std::string>();
+    if (config["healthy_threshold"]) c.health_check.healthy_threshold = std::max(1, config["healthy_threshold"].as<int>());
+    if (config["unhealthy_threshold"])
+        c.health_check.unhealthy_threshold = std::max(1, config["unhealthy_threshold"].as<int>());
+    if (c.health_check.interval.count() <= 0 || c.health_check.timeout.count() <= 0)
+        throw std::invalid_argument("health_check_interval_ms and health_check_timeout_ms must be positive");
+
+    if (config["outlier_consecutive_failures"])
+        c.outlier.consecutive_failures = config["outlier_consecutive_failures"].as<uint32_t>();
+    if (config["outlier_base_ejection_ms"])
+        c.outlier.base_ejection = std::chrono::milliseconds(config["outlier_base_ejection_ms"].as<int>());
+    if (config["outlier_max_ejection_ms"])
+        c.outlier.max_ejection = std::chrono::milliseconds(config["outlier_max_ejection_ms"].as<int>());
+    if (config["outlier_max_ejection_percent"])
+        c.outlier.max_ejection_percent = config["outlier_max_ejection_percent"].as<int>();
+    if (c.outlier.base_ejection.count() <= 0 || c.outlier.max_ejection < c.outlier.base_ejection)
+        throw std::invalid_argument("outlier ejection times must be positive, max >= base");
+    if (c.outlier.max_ejection_percent < 0 || c.outlier.max_ejection_percent > 100)
+        throw std::invalid_argument("outlier_max_ejection_percent must be in [0, 100]");
+
+    if (config["max_connections"]) c.admission.max_connections = config["max_connections"].as<int>();
+    if (config["max_connections_per_backend"])
+        c.admission.max_connections_per_backend = config["max_connections_per_backend"].as<int>();
+    if (config["max_pending"]) c.admission.max_pending = config["max_pending"].as<size_t>();
+    if (config["pending_timeout_ms"])
+        c.admission.pending_timeout = std::chrono::milliseconds(config["pending_timeout_ms"].as<int>());
+    if (c.admission.pending_timeout.count() <= 0) throw std::invalid_argument("pending_timeout_ms must be positive");
+
+    if (config["log_level"]) c.log_level = parse_log_level(config["log_level"].as<std::string>());
+    if (config["log_rate_limit"]) c.log_rate_limit = config["log_rate_limit"].as<uint32_t>();
+    if (config["access_log"]) c.access_log = config["access_log"].as<std::string>();
+
+    std::set<std::string> names;
+    for (const auto& node : config["targets"]) {
+        TargetSpec t;
+        t.name = node["name"].as<std::string>();
+        t.host = node["host"] ? node["host"].as<std::string>() : "127.0.0.1";
+        t.port = node["host_port"].as<int>();
+        t.cgroup_path = node["cgroup_path"] ? node["cgroup_path"].as<std::string>() : "";
+        if (!names.insert(t.name).second) throw std::invalid_argument("duplicate target name: " + t.name);
+        c.targets.push_back(std::move(t));
+    }
+    return c;
+}
+
+bool health_check_changed(const LbConfig& current, const LbConfig& next) {
+    const HealthCheckOptions& a = current.health_check;
+    const HealthCheckOptions& b = next.health_check;
+    return a.type != b.type || a.interval != b.interval || a.timeout != b.timeout || a.http_path != b.http_path
+        || a.healthy_threshold != b.healthy_threshold || a.unhealthy_threshold != b.unhealthy_threshold;
+}
+
+bool load_source_changed(const LbConfig& current, const LbConfig& next) {
+    if (current.load_source != next.load_source) return true;
+    if (next.load_source == "docker")
+        return current.docker_socket != next.docker_socket || current.monitor_interval != next.monitor_interval;
+    if (next.load_source == "cgroup")
+        return current.cgroup_root != next.cgroup_root || current.cgroup_sample_ms != next.cgroup_sample_ms;
+    return false;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "proxy_server.h"
+#include "shared_state.h"
+#include "strategy.h"
+#include "logger.h"
+#include "health_checker.h"
+#include "admission.h"
+
+// Everything config.yaml can set, parsed and validated up front so a reload
+// either applies a complete config or none of it.
+struct LbConfig {
+    // Fixed for the life of the process (a reload only warns on change)
+    int listen_port = 0;
+    int worker_threads = 1;
+    int admin_port = 0;
+    ProxyOptions proxy;
+
+    // Applied on reload
+    std::string strategy = "least_cpu";
+    StrategyOptions strategy_options;
+    double ewma_alpha = 0.3;
+
+    std::string load_source = "docker";
+    int monitor_interval = 5;   // seconds
+    std::string docker_socket = "/var/run/docker.sock";
+    std::string cgroup_root = "/sys/fs/cgroup";
+    int cgroup_sample_ms = 250;
+
+    HealthCheckOptions health_check;
+    OutlierOptions outlier;
+    AdmissionOptions admission;
+
+    LogLevel log_level = LogLevel::Info;
+    uint32_t log_rate_limit = 10;
+    std::string access_log;
+
+    std::vector<TargetSpec> targets;
+};
+
+// Parse a config file; throws (YAML::Exception, std::invalid_argument) on
+// anything missing or malformed, including duplicate target names.
+LbConfig load_config(const std::string& path);
+
+// True if the load source has to be rebuilt to pick up `next`
+bool load_source_changed(const LbConfig& current, const LbConfig& next);
+
+// True if the health checker has to be rebuilt to pick up `next`
+bool health_check_changed(const LbConfig& current, const LbConfig& next);
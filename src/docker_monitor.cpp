@@ -1,31 +1,14 @@
 #include "docker_monitor.h"
-#include <iostream>
-#include <sstream>
-#include <cstdlib>
-#include <cstdio>
+#include "logger.h"
 #include <mutex>
 #include <chrono>
 #include <thread>
-#include <curl/curl.h>
-#include <nlohmann/json.hpp>
+#include <set>
 
 using json = nlohmann::json;
 
-// Helper: read command output
-static std::string exec_cmd(const std::string& cmd) {
-    std::array<char, 128> buffer{};
-    std::string result;
-    FILE* pipe = popen(cmd.c_str(), "r");
-    if (!pipe) return "";
-    while (fgets(buffer.data(), buffer.size(), pipe)) {
-        result += buffer.data();
-    }
-    pclose(pipe);
-    return result;
-}
-
-DockerMonitor::DockerMonitor(SharedState& state, int interval_seconds)
-    : state_(state), interval_seconds_(interval_seconds) {}
+DockerMonitor::DockerMonitor(SharedState& state, int interval_seconds, std::string socket_path)
+    : state_(state), interval_seconds_(interval_seconds), socket_path_(std::move(socket_path)) {}
 
 DockerMonitor::~DockerMonitor() {
     stop();
@@ -50,7 +33,13 @@ double DockerMonitor::compute_cpu_percent(const nlohmann::json& stats_json) {
                             - stats_json["precpu_stats"]["system_cpu_usage"].get<double>();
 
         if (system_delta > 0.0 && cpu_delta > 0.0) {
-            int cores = stats_json["cpu_stats"]["online_cpus"].get<int>();
+            const auto& cpu_stats = stats_json["cpu_stats"];
+            int cores = 0;
+            if (cpu_stats.contains("online_cpus"))
+                cores = cpu_stats["online_cpus"].get<int>();
+            else if (cpu_stats["cpu_usage"].contains("percpu_usage"))   // older daemons
+                cores = static_cast<int>(cpu_stats["cpu_usage"]["percpu_usage"].size());
+            if (cores <= 0) cores = 1;
             return (cpu_delta / system_delta) * cores * 100.0;
         }
     } catch (...) {
@@ -59,50 +48,130 @@ double DockerMonitor::compute_cpu_percent(const nlohmann::json& stats_json) {
     return 0.0;
 }
 
+// curl write callback: the stats stream is newline-delimited JSON
+size_t DockerMonitor::on_data(char* data, size_t size, size_t nmemb, void* userp) {
+    auto* stream = static_cast<Stream*>(userp);
+    size_t bytes = size * nmemb;
+    stream->pending.append(data, bytes);
+
+    size_t start = 0;
+    size_t nl;
+    while ((nl = stream->pending.find('\n', start)) != std::string::npos) {
+        if (nl > start) stream->owner->handle_line(*stream, stream->pending.substr(start, nl - start));
+        start = nl + 1;
+    }
+    stream->pending.erase(0, start);
+    return bytes;
+}
+
+void DockerMonitor::handle_line(Stream& stream, const std::string& line) {
+    long status = 0;
+    curl_easy_getinfo(stream.easy, CURLINFO_RESPONSE_CODE, &status);
+
+    try {
+        json stats_json = json::parse(line);
+        if (status != 200) {
+            // e.g. 404 {"message":"No such container: app1"}
+            LOG_ERROR("Monitor: %s: HTTP %ld %s", stream.name.c_str(), status,
+                      stats_json.value("message", "").c_str());
+            state_.update_target_stats(stream.name, 0.0, false);
+            return;
+        }
+
+        double cpu = compute_cpu_percent(stats_json);
+        state_.update_target_stats(stream.name, cpu, true);
+        LOG_DEBUG("Monitor: %s CPU%%=%.2f", stream.name.c_str(), cpu);
+    } catch (const std::exception& e) {
+        LOG_ERROR("Monitor: JSON parse failed for %s: %s", stream.name.c_str(), e.what());
+    }
+}
+
+void DockerMonitor::open_stream(CURLM* multi, Stream& stream) {
+    CURL* easy = curl_easy_init();
+    if (!easy) return;
+
+    char* escaped = curl_easy_escape(easy, stream.name.c_str(), 0);
+    std::string url = std::string("http://localhost/containers/") + escaped + "/stats?stream=true";
+    curl_free(escaped);
+
+    curl_easy_setopt(easy, CURLOPT_UNIX_SOCKET_PATH, socket_path_.c_str());
+    curl_easy_setopt(easy, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, &DockerMonitor::on_data);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, &stream);
+    curl_easy_setopt(easy, CURLOPT_PRIVATE, &stream);
+    curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT, 5L);
+    curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+
+    stream.easy = easy;
+    stream.pending.clear();
+    curl_multi_add_handle(multi, easy);
+}
+
+void DockerMonitor::close_stream(CURLM* multi, Stream& stream, bool retry) {
+    if (!stream.easy) return;
+    curl_multi_remove_handle(multi, stream.easy);
+    curl_easy_cleanup(stream.easy);
+    stream.easy = nullptr;
+    if (retry)
+        stream.retry_at = std::chrono::steady_clock::now() + std::chrono::seconds(interval_seconds_);
+}
+
 // Background thread loop
 void DockerMonitor::run_loop() {
+    CURLM* multi = curl_multi_init();
+    if (!multi) {
+        LOG_ERROR("Monitor: curl_multi_init failed");
+        return;
+    }
+
     while (running_.load()) {
         try {
-            auto snapshot = state_.snapshot();
-            for (auto& t : snapshot) {
-                std::ostringstream cmd;
-                cmd << "docker stats " << t.name << " --no-stream --format '{{json .}}'";
-                std::string output = exec_cmd(cmd.str());
-                if (output.empty()) {
-                    state_.update_target_stats(t.name, 0.0, false);
+            // Keep exactly one stream per configured target
+            auto now = std::chrono::steady_clock::now();
+            std::set<std::string> names;
+            for (auto& t : state_.snapshot()) {
+                names.insert(t.name);
+                Stream& stream = streams_[t.name];
+                if (!stream.owner) {
+                    stream.owner = this;
+                    stream.name = t.name;
+                }
+                if (!stream.easy && now >= stream.retry_at) open_stream(multi, stream);
+            }
+            for (auto it = streams_.begin(); it != streams_.end();) {
+                if (names.count(it->first)) {
+                    ++it;
                     continue;
                 }
+                close_stream(multi, it->second, false);
+                it = streams_.erase(it);
+            }
 
-                try {
-                    // Docker --format '{{json .}}' returns multiple JSON lines
-                    std::istringstream ss(output);
-                    std::string line;
-                    double avg_cpu = 0;
-                    int count = 0;
-
-                    while (std::getline(ss, line)) {
-                        if (line.empty()) continue;
-                        json stats_json = json::parse(line);
-                        std::string cpu_str = stats_json["CPUPerc"];
-                        cpu_str.erase(std::remove(cpu_str.begin(), cpu_str.end(), '%'), cpu_str.end());
-                        avg_cpu += std::stod(cpu_str);
-                        count++;
-                    }
-
-                    if (count > 0) avg_cpu /= count;
-                    state_.update_target_stats(t.name, avg_cpu, true);
-                    std::cout << "[Monitor] " << t.name << " CPU%=" << avg_cpu << std::endl;
-                } catch (const std::exception& e) {
-                    std::cerr << "[Monitor ERROR] JSON parse failed for " << t.name
-                              << ": " << e.what() << std::endl;
-                    state_.update_target_stats(t.name, 0.0, false);
-                }
+            int still_running = 0;
+            curl_multi_perform(multi, &still_running);
+
+            // A finished transfer means the stream broke (daemon restart,
+            // container removed, bad status): mark the target down and retry.
+            int queued = 0;
+            while (CURLMsg* msg = curl_multi_info_read(multi, &queued)) {
+                if (msg->msg != CURLMSG_DONE) continue;
+                Stream* stream = nullptr;
+                curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &stream);
+                if (!stream) continue;
+                LOG_ERROR("Monitor: stats stream for %s ended: %s", stream->name.c_str(),
+                          msg->data.result == CURLE_OK ? "closed by daemon"
+                                                       : curl_easy_strerror(msg->data.result));
+                state_.update_target_stats(stream->name, 0.0, false);
+                close_stream(multi, *stream, true);
             }
+
+            curl_multi_poll(multi, nullptr, 0, 200, nullptr);
         } catch (const std::exception& e) {
-            std::cerr << "[Monitor ERROR] " << e.what() << std::endl;
+            LOG_ERROR("Monitor: %s", e.what());
         }
-
-        std::this_thread::sleep_for(std::chrono::seconds(interval_seconds_));
     }
-}
 
+    for (auto& [name, stream] : streams_) close_stream(multi, stream, false);
+    streams_.clear();
+    curl_multi_cleanup(multi);
+}
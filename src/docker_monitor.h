@@ -1,23 +1,49 @@
 #pragma once
 #include "shared_state.h"
+#include "load_source.h"
 #include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
 #include <thread>
-#include <nlohmann/json.hpp>   // ✅ add this include
+#include <curl/curl.h>
+#include <nlohmann/json.hpp>
 
-class DockerMonitor {
+// Samples container CPU straight from the Docker Engine API over its unix
+// socket. Each target gets one long-lived streaming
+// GET /containers/{name}/stats request; all streams are multiplexed on a
+// single curl multi handle in the monitor thread, and every sample the
+// daemon pushes (about once a second) is fed through compute_cpu_percent.
+class DockerMonitor : public LoadSource {
 public:
-    DockerMonitor(SharedState& state, int interval_seconds = 5);
-    ~DockerMonitor();
+    DockerMonitor(SharedState& state, int interval_seconds = 5,
+                  std::string socket_path = "/var/run/docker.sock");
+    ~DockerMonitor() override;
 
-    void start();
-    void stop();
+    void start() override;
+    void stop() override;
+
+    static double compute_cpu_percent(const nlohmann::json& stats_json);
 
 private:
+    struct Stream {
+        DockerMonitor* owner = nullptr;
+        std::string name;
+        CURL* easy = nullptr;
+        std::string pending;                 // partial JSON line
+        std::chrono::steady_clock::time_point retry_at{};
+    };
+
     void run_loop();
-    double compute_cpu_percent(const nlohmann::json& stats_json);
+    void open_stream(CURLM* multi, Stream& stream);
+    void close_stream(CURLM* multi, Stream& stream, bool retry);
+    void handle_line(Stream& stream, const std::string& line);
+    static size_t on_data(char* data, size_t size, size_t nmemb, void* userp);
 
     SharedState& state_;
-    int interval_seconds_;
+    int interval_seconds_;                   // retry delay after a stream ends
+    std::string socket_path_;
     std::atomic<bool> running_{false};
     std::thread worker_;
+    std::map<std::string, Stream> streams_;  // monitor thread only
 };
@@ -0,0 +1,211 @@
+#include "health_checker.h"
+#include "http_parser.h"
+#include "logger.h"
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+
+using boost::asio::ip::tcp;
+
+// How often ejections are checked for expiry
+static constexpr std::chrono::milliseconds kExpiryTick{100};
+
+HealthCheckType parse_health_check_type(const std::string& name) {
+    if (name == "none") return HealthCheckType::None;
+    if (name == "tcp") return HealthCheckType::Tcp;
+    if (name == "http") return HealthCheckType::Http;
+    throw std::invalid_argument("unknown health_check: " + name);
+}
+
+namespace {
+
+// One probe of one target: connect, and in http mode send a GET and read
+// the status line. The whole exchange shares a single deadline.
+class Probe : public std::enable_shared_from_this<Probe> {
+public:
+    using Handler = std::function<void(bool ok)>;
+
+    Probe(boost::asio::io_context& io_context, const HealthCheckOptions& options,
+          BackendHandle target, Handler handler)
+        : options_(options),
+          target_(std::move(target)),
+          handler_(std::move(handler)),
+          socket_(io_context),
+          timer_(io_context) {}
+
+    void start() {
+        auto self = shared_from_this();
+        timer_.expires_after(options_.timeout);
+        timer_.async_wait([this, self](const boost::system::error_code& ec) {
+            if (!ec) finish(false);
+        });
+        socket_.async_connect(target_->endpoint, [this, self](const boost::system::error_code& ec) {
+            if (done_) return;
+            if (ec) {
+                finish(false);
+                return;
+            }
+            if (options_.type == HealthCheckType::Tcp) {
+                finish(true);
+                return;
+            }
+            send_request();
+        });
+    }
+
+private:
+    void send_request() {
+        request_ = "GET " + options_.http_path + " HTTP/1.1\r\n"
+                   "Host: " + target_->host + ":" + std::to_string(target_->port) + "\r\n"
+                   "User-Agent: custom_lb-health\r\n"
+                   "Connection: close\r\n\r\n";
+        auto self = shared_from_this();
+        boost::asio::async_write(socket_, boost::asio::buffer(request_),
+            [this, self](const boost::system::error_code& ec, std::size_t) {
+                if (done_) return;
+                if (ec) {
+                    finish(false);
+                    return;
+                }
+                read_response();
+            });
+    }
+
+    void read_response() {
+        auto self = shared_from_this();
+        socket_.async_read_some(boost::asio::buffer(buffer_.data() + length_, buffer_.size() - length_),
+            [this, self](const boost::system::error_code& ec, std::size_t n) {
+                if (done_) return;
+                length_ += n;
+                HttpHead head;
+                auto result = parse_response_head(buffer_.data(), length_, scanned_, head);
+                if (result == ParseResult::Complete) {
+                    finish(head.status >= 200 && head.status < 400);
+                    return;
+                }
+                if (ec || result == ParseResult::Error || length_ == buffer_.size()) {
+                    finish(false);
+                    return;
+                }
+                read_response();
+            });
+    }
+
+    void finish(bool ok) {
+        if (done_) return;
+        done_ = true;
+        timer_.cancel();
+        boost::system::error_code ignored;
+        socket_.close(ignored);
+        handler_(ok);
+    }
+
+    const HealthCheckOptions& options_;
+    BackendHandle target_;
+    Handler handler_;
+    tcp::socket socket_;
+    boost::asio::steady_timer timer_;
+    std::string request_;
+    std::array<char, 4096> buffer_;
+    size_t length_ = 0;
+    size_t scanned_ = 0;
+    bool done_ = false;
+};
+
+}  // namespace
+
+HealthChecker::HealthChecker(SharedState& state, const HealthCheckOptions& options)
+    : state_(state),
+      options_(options),
+      probe_timer_(io_context_),
+      expiry_timer_(io_context_) {}
+
+HealthChecker::~HealthChecker() {
+    stop();
+}
+
+void HealthChecker::start() {
+    running_.store(true);
+    boost::asio::post(io_context_, [this]() {
+        run_probes();
+        schedule_probes();
+        schedule_expiry();
+    });
+    thread_ = std::thread([this]() {
+        while (running_.load()) {
+            io_context_.run_for(std::chrono::milliseconds(200));
+        }
+    });
+}
+
+void HealthChecker::stop() {
+    running_.store(false);
+    if (thread_.joinable()) thread_.join();
+}
+
+void HealthChecker::schedule_probes() {
+    probe_timer_.expires_after(options_.interval);
+    probe_timer_.async_wait([this](const boost::system::error_code& ec) {
+        if (ec) return;
+        run_probes();
+        schedule_probes();
+    });
+}
+
+void HealthChecker::schedule_expiry() {
+    expiry_timer_.expires_after(kExpiryTick);
+    expiry_timer_.async_wait([this](const boost::system::error_code& ec) {
+        if (ec) return;
+        state_.expire_ejections();
+        schedule_expiry();
+    });
+}
+
+void HealthChecker::run_probes() {
+    auto targets = state_.targets();
+
+    // forget targets a reload removed
+    for (auto it = probes_.begin(); it != probes_.end();) {
+        bool present = std::any_of(targets.begin(), targets.end(),
+                                   [&](const BackendHandle& t) { return t.get() == it->first; });
+        it = present ? std::next(it) : probes_.erase(it);
+    }
+
+    for (auto& t : targets) {
+        if (options_.type == HealthCheckType::None) {
+            // probing was switched off by a reload: drop any old verdict
+            if (!t->probe_healthy.load()) state_.set_probe_health(*t, true);
+            continue;
+        }
+        ProbeState& p = probes_[t.get()];
+        if (p.in_flight) continue;   // still within its timeout
+        p.in_flight = true;
+        std::make_shared<Probe>(io_context_, options_, t, [this, t](bool ok) { on_result(t, ok); })->start();
+    }
+}
+
+void HealthChecker::on_result(const BackendHandle& target, bool ok) {
+    // only run_probes adds entries, so a miss means a reload removed the target
+    auto it = probes_.find(target.get());
+    if (it == probes_.end()) return;
+    ProbeState& p = it->second;
+    p.in_flight = false;
+    if (ok) {
+        p.failures = 0;
+        if (p.successes < options_.healthy_threshold) ++p.successes;
+        if (p.successes >= options_.healthy_threshold && !target->probe_healthy.load()) {
+            LOG_INFO("Health check passing for %s, back in rotation", target->name.c_str());
+            state_.set_probe_health(*target, true);
+        }
+    } else {
+        p.successes = 0;
+        if (p.failures < options_.unhealthy_threshold) ++p.failures;
+        if (p.failures >= options_.unhealthy_threshold && target->probe_healthy.load()) {
+            LOG_WARN("Health check failing for %s:%d, taking it out of rotation",
+                     target->host.c_str(), target->port);
+            state_.set_probe_health(*target, false);
+        }
+    }
+}
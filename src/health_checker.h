@@ -0,0 +1,62 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "shared_state.h"
+
+enum class HealthCheckType {
+    None,   // rely on the load source and passive outlier detection only
+    Tcp,    // connect succeeds
+    Http    // GET health_check_path answers 2xx or 3xx
+};
+
+// Parse "none" / "tcp" / "http"; throws std::invalid_argument otherwise.
+HealthCheckType parse_health_check_type(const std::string& name);
+
+struct HealthCheckOptions {
+    HealthCheckType type = HealthCheckType::None;
+    std::chrono::milliseconds interval{5000};
+    std::chrono::milliseconds timeout{1000};   // connect + response, per probe
+    std::string http_path = "/";
+    int healthy_threshold = 2;                 // passes in a row to come back
+    int unhealthy_threshold = 3;               // failures in a row to go down
+};
+
+// Active health checks: probes every target on its own io_context and
+// thread, so a slow or hanging backend never touches a proxy worker, and
+// feeds the verdicts to SharedState::set_probe_health(). Also drives the
+// Open -> HalfOpen step of passive outlier detection, which needs a clock
+// even when probing is off.
+class HealthChecker {
+public:
+    HealthChecker(SharedState& state, const HealthCheckOptions& options);
+    ~HealthChecker();
+
+    void start();
+    void stop();
+
+private:
+    struct ProbeState {
+        int successes = 0;
+        int failures = 0;
+        bool in_flight = false;
+    };
+
+    void schedule_probes();
+    void schedule_expiry();
+    void run_probes();
+    void on_result(const BackendHandle& target, bool ok);
+
+    boost::asio::io_context io_context_;   // first: outlives the timers and probes
+    SharedState& state_;
+    HealthCheckOptions options_;
+    boost::asio::steady_timer probe_timer_;
+    boost::asio::steady_timer expiry_timer_;
+    std::atomic<bool> running_{false};
+    std::thread thread_;
+    std::unordered_map<const TargetInfo*, ProbeState> probes_;   // checker thread only
+};
@@ -0,0 +1,252 @@
+#include "http_parser.h"
+#include <cstring>
+
+static bool iequals(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        char x = a[i], y = b[i];
+        if (x >= 'A' && x <= 'Z') x = static_cast<char>(x - 'A' + 'a');
+        if (y >= 'A' && y <= 'Z') y = static_cast<char>(y - 'A' + 'a');
+        if (x != y) return false;
+    }
+    return true;
+}
+
+static std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+// Calls fn(token) for each comma-separated token of a header value
+template <typename Fn>
+static void for_each_token(std::string_view value, Fn fn) {
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        fn(trim(value.substr(0, comma)));
+        if (comma == std::string_view::npos) break;
+        value.remove_prefix(comma + 1);
+    }
+}
+
+static bool parse_version(std::string_view v, int& minor) {
+    if (v.size() != 8 || v.substr(0, 7) != "HTTP/1.") return false;
+    if (v[7] < '0' || v[7] > '9') return false;
+    minor = v[7] - '0';
+    return true;
+}
+
+// Find the end of the head; returns its length or 0 if not there yet
+static size_t find_head_end(const char* data, size_t len, size_t& scanned) {
+    size_t from = scanned > 3 ? scanned - 3 : 0;
+    if (len >= 4) {
+        const void* hit = memmem(data + from, len - from, "\r\n\r\n", 4);
+        if (hit) return static_cast<const char*>(hit) - data + 4;
+    }
+    scanned = len;
+    return 0;
+}
+
+// Header fields after the start line; shared by requests and responses
+static bool parse_fields(std::string_view fields, HttpHead& head) {
+    bool keep_alive_token = false;
+    bool close_token = false;
+
+    while (!fields.empty()) {
+        size_t eol = fields.find("\r\n");
+        std::string_view line = fields.substr(0, eol);
+        fields.remove_prefix(eol == std::string_view::npos ? fields.size() : eol + 2);
+        if (line.empty()) break;
+        if (line.front() == ' ' || line.front() == '\t') return false;   // obsolete folding
+
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos || colon == 0) return false;
+        std::string_view name = line.substr(0, colon);
+        if (name.back() == ' ' || name.back() == '\t') return false;
+        std::string_view value = trim(line.substr(colon + 1));
+
+        if (iequals(name, "content-length")) {
+            if (value.empty()) return false;
+            uint64_t n = 0;
+            for (char c : value) {
+                if (c < '0' || c > '9' || n > (UINT64_MAX - 9) / 10) return false;
+                n = n * 10 + static_cast<uint64_t>(c - '0');
+            }
+            // repeated Content-Length must agree, or framing is ambiguous
+            if (head.has_content_length && head.content_length != n) return false;
+            head.has_content_length = true;
+            head.content_length = n;
+        } else if (iequals(name, "transfer-encoding")) {
+            head.transfer_encoding = true;
+            head.chunked = false;
+            for_each_token(value, [&](std::string_view token) {
+                head.chunked = iequals(token, "chunked");   // must be the last coding
+            });
+        } else if (iequals(name, "connection")) {
+            for_each_token(value, [&](std::string_view token) {
+                if (iequals(token, "close")) close_token = true;
+                else if (iequals(token, "keep-alive")) keep_alive_token = true;
+                else if (iequals(token, "upgrade")) head.upgrade = true;
+            });
+        }
+    }
+
+    // Both framings at once is the classic request smuggling vector
+    if (head.transfer_encoding && head.has_content_length) return false;
+    if (head.transfer_encoding && !head.chunked) head.keep_alive = false;   // body ends at close
+
+    if (close_token) head.keep_alive = false;
+    else if (head.version_minor == 0) head.keep_alive = keep_alive_token;
+    return true;
+}
+
+ParseResult parse_request_head(const char* data, size_t len, size_t& scanned, HttpHead& head) {
+    size_t end = find_head_end(data, len, scanned);
+    if (!end) return ParseResult::Incomplete;
+
+    head = HttpHead{};
+    head.length = end;
+    std::string_view text(data, end);
+
+    // request-line = method SP request-target SP HTTP-version CRLF
+    size_t eol = text.find("\r\n");
+    std::string_view line = text.substr(0, eol);
+    size_t sp1 = line.find(' ');
+    size_t sp2 = line.rfind(' ');
+    if (sp1 == std::string_view::npos || sp1 == 0 || sp2 == sp1) return ParseResult::Error;
+    head.method = line.substr(0, sp1);
+    head.target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+    if (!parse_version(line.substr(sp2 + 1), head.version_minor)) return ParseResult::Error;
+
+    if (!parse_fields(text.substr(eol + 2), head)) return ParseResult::Error;
+    // a request with an unknown transfer coding cannot be delimited
+    if (head.transfer_encoding && !head.chunked) return ParseResult::Error;
+    return ParseResult::Complete;
+}
+
+ParseResult parse_response_head(const char* data, size_t len, size_t& scanned, HttpHead& head) {
+    size_t end = find_head_end(data, len, scanned);
+    if (!end) return ParseResult::Incomplete;
+
+    head = HttpHead{};
+    head.length = end;
+    std::string_view text(data, end);
+
+    // status-line = HTTP-version SP status-code SP [ reason-phrase ] CRLF
+    size_t eol = text.find("\r\n");
+    std::string_view line = text.substr(0, eol);
+    if (line.size() < 12 || line[8] != ' ') return ParseResult::Error;
+    if (!parse_version(line.substr(0, 8), head.version_minor)) return ParseResult::Error;
+    for (size_t i = 9; i < 12; ++i) {
+        if (line[i] < '0' || line[i] > '9') return ParseResult::Error;
+        head.status = head.status * 10 + (line[i] - '0');
+    }
+
+    if (!parse_fields(text.substr(eol + 2), head)) return ParseResult::Error;
+    return ParseResult::Complete;
+}
+
+BodyFramer::Mode request_body_mode(const HttpHead& request) {
+    if (request.chunked) return BodyFramer::Mode::Chunked;
+    if (request.has_content_length && request.content_length > 0) return BodyFramer::Mode::Length;
+    return BodyFramer::Mode::None;
+}
+
+BodyFramer::Mode response_body_mode(const HttpHead& response, bool head_request) {
+    if (head_request || (response.status >= 100 && response.status < 200)
+        || response.status == 204 || response.status == 304)
+        return BodyFramer::Mode::None;
+    if (response.chunked) return BodyFramer::Mode::Chunked;
+    if (response.has_content_length)
+        return response.content_length > 0 ? BodyFramer::Mode::Length : BodyFramer::Mode::None;
+    return BodyFramer::Mode::UntilClose;
+}
+
+void BodyFramer::reset(Mode mode, uint64_t length) {
+    mode_ = mode;
+    remaining_ = length;
+    size_digits_ = false;
+    switch (mode) {
+    case Mode::None:       state_ = State::Done; break;
+    case Mode::Length:     state_ = length ? State::Length : State::Done; break;
+    case Mode::Chunked:    state_ = State::Size; remaining_ = 0; break;
+    case Mode::UntilClose: state_ = State::UntilClose; break;
+    }
+}
+
+size_t BodyFramer::consume(const char* data, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+        switch (state_) {
+        case State::Done:
+        case State::Error:
+            return i;
+
+        case State::UntilClose:
+            return n;
+
+        case State::Length:
+        case State::Data: {
+            uint64_t take = remaining_ < n - i ? remaining_ : n - i;
+            i += static_cast<size_t>(take);
+            remaining_ -= take;
+            if (remaining_ == 0) state_ = state_ == State::Length ? State::Done : State::DataCR;
+            break;
+        }
+
+        case State::Size: {
+            char c = data[i++];
+            int digit = -1;
+            if (c >= '0' && c <= '9') digit = c - '0';
+            else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+
+            if (digit >= 0) {
+                if (remaining_ >> 60) { state_ = State::Error; break; }   // overflow
+                remaining_ = remaining_ * 16 + static_cast<uint64_t>(digit);
+                size_digits_ = true;
+            } else if (!size_digits_) {
+                state_ = State::Error;
+            } else if (c == ';' || c == ' ' || c == '\t') {
+                state_ = State::Extension;
+            } else if (c == '\r') {
+                state_ = State::SizeLF;
+            } else {
+                state_ = State::Error;
+            }
+            break;
+        }
+
+        case State::Extension:
+            if (data[i++] == '\r') state_ = State::SizeLF;
+            break;
+
+        case State::SizeLF:
+            if (data[i++] != '\n') { state_ = State::Error; break; }
+            size_digits_ = false;
+            state_ = remaining_ == 0 ? State::TrailerStart : State::Data;
+            break;
+
+        case State::DataCR:
+            state_ = data[i++] == '\r' ? State::DataLF : State::Error;
+            break;
+
+        case State::DataLF:
+            state_ = data[i++] == '\n' ? State::Size : State::Error;
+            break;
+
+        case State::TrailerStart:
+            state_ = data[i++] == '\r' ? State::FinalLF : State::TrailerLine;
+            break;
+
+        case State::TrailerLine:
+            if (data[i++] == '\n') state_ = State::TrailerStart;
+            break;
+
+        case State::FinalLF:
+            state_ = data[i++] == '\n' ? State::Done : State::Error;
+            break;
+        }
+    }
+    return i;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Minimal incremental HTTP/1.x framing for the L7 proxy mode. Nothing is
+// copied or rewritten: the parser only finds message boundaries in the
+// caller's buffer so the bytes can be forwarded as they are.
+
+struct HttpHead {
+    std::string_view method;          // requests only; points into the buffer
+    std::string_view target;          // requests only, e.g. "/metrics"
+    int status = 0;                   // responses only
+    int version_minor = 1;            // HTTP/1.<minor>
+    bool keep_alive = true;           // after version default + Connection
+    bool transfer_encoding = false;   // any Transfer-Encoding header
+    bool chunked = false;             // ... whose final coding is chunked
+    bool has_content_length = false;
+    uint64_t content_length = 0;
+    bool upgrade = false;             // Connection: upgrade
+    size_t length = 0;                // head size including the blank line
+};
+
+enum class ParseResult {
+    Complete,
+    Incomplete,   // need more bytes
+    Error
+};
+
+// Parse a request/response head starting at data[0]. `scanned` carries the
+// offset searched so far between calls so a slow head is not rescanned.
+ParseResult parse_request_head(const char* data, size_t len, size_t& scanned, HttpHead& head);
+ParseResult parse_response_head(const char* data, size_t len, size_t& scanned, HttpHead& head);
+
+// Tracks where a message body ends in a byte stream, including chunked
+// bodies (sizes, extensions and trailers), without de-chunking it.
+class BodyFramer {
+public:
+    enum class Mode {
+        None,
+        Length,
+        Chunked,
+        UntilClose    // response delimited by the backend closing
+    };
+
+    void reset(Mode mode, uint64_t length = 0);
+
+    // Consume up to n bytes of body; returns how many belong to this message.
+    // Bytes past the returned count start the next message.
+    size_t consume(const char* data, size_t n);
+
+    bool done() const { return state_ == State::Done; }
+    bool error() const { return state_ == State::Error; }
+    Mode mode() const { return mode_; }
+
+private:
+    enum class State {
+        Length, UntilClose,
+        Size, Extension, SizeLF, Data, DataCR, DataLF,
+        TrailerStart, TrailerLine, FinalLF,
+        Done, Error
+    };
+
+    Mode mode_ = Mode::None;
+    State state_ = State::Done;
+    uint64_t remaining_ = 0;
+    bool size_digits_ = false;
+};
+
+// Body framing per RFC 7230 section 3.3.3
+BodyFramer::Mode request_body_mode(const HttpHead& request);
+BodyFramer::Mode response_body_mode(const HttpHead& response, bool head_request);
@@ -0,0 +1,498 @@
+#include "http_session.h"
+#include "proxy_server.h"
+#include "backend_connector.h"
+#include "relay_session.h"
+#include "logger.h"
+#include <cstring>
+#include <cstdlib>
+
+static const char kBadRequest[] =
+    "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+static const char kHeadTooLarge[] =
+    "HTTP/1.1 431 Request Header Fields Too Large\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+static const char kBadGateway[] =
+    "HTTP/1.1 502 Bad Gateway\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+static const char kUnavailable[] =
+    "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+// RFC 9110 9.2.2: repeating these has the same effect as sending them once
+static bool idempotent_method(std::string_view method) {
+    return method == "GET" || method == "HEAD" || method == "OPTIONS" || method == "TRACE"
+        || method == "PUT" || method == "DELETE";
+}
+
+HttpSession::HttpSession(boost::asio::io_context& io_context, tcp::socket client, SharedState& state,
+                         BackendPool& pool, const ProxyOptions& options, uint64_t hash_key,
+                         AdmissionTicket ticket)
+    : io_context_(io_context),
+      client_(std::move(client)),
+      backend_(io_context),
+      state_(state),
+      pool_(pool),
+      options_(options),
+      hash_key_(hash_key),
+      ticket_(std::move(ticket)),
+      peer_(access_log_peer(client_)),
+      request_buf_(kBufferSize),
+      response_buf_(kBufferSize) {}
+
+void HttpSession::start() {
+    read_request();
+}
+
+// ---------------------------------------------------------------------------
+// Request side
+
+void HttpSession::read_request() {
+    if (closed_) return;
+    if (request_begin_ == request_end_) request_begin_ = request_pos_ = request_end_ = 0;
+
+    HttpHead head;
+    char* data = request_buf_.data();
+    auto result = parse_request_head(data + request_begin_, request_end_ - request_begin_,
+                                     request_scanned_, head);
+    if (result == ParseResult::Complete) {
+        on_request_head(head);
+        return;
+    }
+    if (result == ParseResult::Error) {
+        send_error(kBadRequest);
+        return;
+    }
+
+    // Need more of the head: make room at the end of the buffer
+    if (request_end_ == request_buf_.size()) {
+        if (request_begin_ == 0) {
+            send_error(kHeadTooLarge);
+            return;
+        }
+        std::memmove(data, data + request_begin_, request_end_ - request_begin_);
+        request_end_ -= request_begin_;
+        request_begin_ = request_pos_ = 0;
+    }
+
+    auto self = shared_from_this();
+    client_.async_read_some(boost::asio::buffer(data + request_end_, request_buf_.size() - request_end_),
+        [this, self](const boost::system::error_code& ec, std::size_t length) {
+            if (closed_) return;
+            if (ec) {
+                // EOF between requests is how keep-alive clients say goodbye
+                close();
+                return;
+            }
+            request_end_ += length;
+            read_request();
+        });
+}
+
+void HttpSession::on_request_head(const HttpHead& head) {
+    request_scanned_ = 0;
+    head_request_ = head.method == "HEAD";
+    connect_request_ = head.method == "CONNECT";
+    upgrade_request_ = head.upgrade;
+    client_keep_alive_ = head.keep_alive;
+    request_start_ = std::chrono::steady_clock::now();
+    if (Logger::instance().access_enabled()) {
+        access_method_.assign(head.method);
+        access_target_.assign(head.target);
+    }
+
+    // Frame as much of the body as is already buffered
+    request_pos_ = request_begin_ + head.length;
+    request_body_.reset(connect_request_ ? BodyFramer::Mode::None : request_body_mode(head),
+                        head.content_length);
+    request_pos_ += request_body_.consume(request_buf_.data() + request_pos_, request_end_ - request_pos_);
+    if (request_body_.error()) {
+        send_error(kBadRequest);
+        return;
+    }
+    // A replay can reach a backend that already acted on the request
+    request_resendable_ = request_body_.done() && idempotent_method(head.method);
+
+    SelectionContext selection;
+    selection.hash_key = hash_key_;
+    BackendHandle backend = state_.choose_backend(selection);
+    if (!backend) {
+        LOG_ERROR("No healthy backend available.");
+        send_error(kUnavailable);
+        return;
+    }
+
+    if (auto pooled = pool_.acquire(backend)) {
+        on_backend(std::move(*pooled), std::move(backend), true);
+        return;
+    }
+    acquire_backend(std::move(backend));
+}
+
+// Open a fresh connection, starting with `backend` and failing over from there
+void HttpSession::acquire_backend(BackendHandle backend) {
+    SelectionContext selection;
+    selection.hash_key = hash_key_;
+    auto self = shared_from_this();
+    BackendConnector::connect(io_context_, state_, options_.connect, selection,
+        [this, self](const boost::system::error_code& ec, tcp::socket socket, BackendHandle connected) {
+            if (closed_) return;
+            if (ec) {
+                LOG_ERROR("No backend reachable for request: %s", ec.message().c_str());
+                send_error(connected ? kBadGateway : kUnavailable);
+                return;
+            }
+            boost::system::error_code ignored;
+            socket.set_option(tcp::no_delay(true), ignored);
+            on_backend(std::move(socket), std::move(connected), false);
+        },
+        std::move(backend));
+}
+
+void HttpSession::on_backend(tcp::socket socket, BackendHandle backend, bool reused) {
+    ++attempt_;
+    backend_ = std::move(socket);
+    backend_reused_ = reused;
+    lease_ = BackendLease(state_, std::move(backend));
+
+    request_done_ = false;
+    response_done_ = false;
+    response_head_done_ = false;
+    response_started_ = false;
+    backend_reusable_ = false;
+    first_byte_seen_ = false;
+    response_pos_ = response_end_ = response_scanned_ = 0;
+
+    send_request();
+    read_response();
+}
+
+// Head plus whatever body is buffered, straight from the client buffer
+void HttpSession::send_request() {
+    request_sent_ = std::chrono::steady_clock::now();
+    auto self = shared_from_this();
+    unsigned attempt = attempt_;
+    boost::asio::async_write(backend_,
+        boost::asio::buffer(request_buf_.data() + request_begin_, request_pos_ - request_begin_),
+        [this, self, attempt](const boost::system::error_code& ec, std::size_t length) {
+            if (closed_ || attempt != attempt_) return;
+            if (ec) {
+                on_backend_error(ec);
+                return;
+            }
+            lease_.report_bytes(length, 0);
+            on_request_sent();
+        });
+}
+
+void HttpSession::on_request_sent() {
+    if (!request_body_.done()) {
+        read_request_body();
+        return;
+    }
+    request_done_ = true;
+    if (tunnel_pending_) {
+        start_tunnel();
+        return;
+    }
+    if (response_done_) finish_exchange();
+}
+
+void HttpSession::read_request_body() {
+    // Everything buffered has been forwarded, so the whole buffer is free
+    request_begin_ = request_pos_ = request_end_ = 0;
+    request_resendable_ = false;
+
+    auto self = shared_from_this();
+    unsigned attempt = attempt_;
+    client_.async_read_some(boost::asio::buffer(request_buf_),
+        [this, self, attempt](const boost::system::error_code& ec, std::size_t length) {
+            if (closed_ || attempt != attempt_) return;
+            if (ec) {
+                close();   // client gave up mid-request
+                return;
+            }
+            request_end_ = length;
+            request_pos_ = request_body_.consume(request_buf_.data(), length);
+            if (request_body_.error()) {
+                close();
+                return;
+            }
+            boost::asio::async_write(backend_, boost::asio::buffer(request_buf_.data(), request_pos_),
+                [this, self, attempt](const boost::system::error_code& write_ec, std::size_t written) {
+                    if (closed_ || attempt != attempt_) return;
+                    if (write_ec) {
+                        on_backend_error(write_ec);
+                        return;
+                    }
+                    lease_.report_bytes(written, 0);
+                    on_request_sent();
+                });
+        });
+}
+
+// ---------------------------------------------------------------------------
+// Response side
+
+void HttpSession::read_response() {
+    auto self = shared_from_this();
+    unsigned attempt = attempt_;
+    backend_.async_read_some(
+        boost::asio::buffer(response_buf_.data() + response_end_, response_buf_.size() - response_end_),
+        [this, self, attempt](const boost::system::error_code& ec, std::size_t length) {
+            if (closed_ || attempt != attempt_) return;
+            if (ec == boost::asio::error::eof && response_head_done_
+                && response_body_.mode() == BodyFramer::Mode::UntilClose) {
+                on_response_end(true);
+                return;
+            }
+            if (ec) {
+                on_backend_error(ec);
+                return;
+            }
+            if (!first_byte_seen_) {
+                first_byte_seen_ = true;
+                lease_.report_latency(LatencyKind::FirstByte,
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - request_sent_));
+            }
+            response_end_ += length;
+            lease_.report_bytes(0, length);
+            process_response();
+        });
+}
+
+void HttpSession::process_response() {
+    char* data = response_buf_.data();
+
+    if (!response_head_done_) {
+        HttpHead head;
+        auto result = parse_response_head(data + response_pos_, response_end_ - response_pos_,
+                                          response_scanned_, head);
+        if (result == ParseResult::Incomplete) {
+            if (response_pos_ > 0) {
+                std::memmove(data, data + response_pos_, response_end_ - response_pos_);
+                response_end_ -= response_pos_;
+                response_pos_ = 0;
+            }
+            if (response_end_ == response_buf_.size()) {
+                request_resendable_ = false;
+                on_backend_error(boost::asio::error::message_size);
+                return;
+            }
+            read_response();
+            return;
+        }
+        if (result == ParseResult::Error) {
+            request_resendable_ = false;   // a broken backend, not a stale connection
+            on_backend_error(boost::asio::error::invalid_argument);
+            return;
+        }
+
+        if (head.status == 101 && !upgrade_request_) {
+            // a switch nobody asked for: the client can't speak the new protocol
+            request_resendable_ = false;
+            on_backend_error(boost::asio::error::invalid_argument);
+            return;
+        }
+
+        response_scanned_ = 0;
+        response_status_ = head.status;
+        // passive health: gateway errors count against the backend like resets
+        if (head.status == 502 || head.status == 503 || head.status == 504) lease_.report_failure();
+        else if (head.status >= 200 || head.status == 101) lease_.report_success();
+        size_t begin = response_pos_;
+        response_pos_ += head.length;
+
+        if (head.status == 101 || (connect_request_ && head.status / 100 == 2)) {
+            // Everything after the head already belongs to the tunnel
+            tunnel_ = true;
+            forward_response(begin, response_end_);
+            return;
+        }
+        if (head.status >= 100 && head.status < 200) {
+            forward_response(begin, response_pos_);   // interim, e.g. 100 Continue
+            return;
+        }
+
+        response_head_done_ = true;
+        response_body_.reset(response_body_mode(head, head_request_), head.content_length);
+        backend_reusable_ = head.keep_alive && response_body_.mode() != BodyFramer::Mode::UntilClose;
+        // We forward the backend's Connection header as-is, so honour it
+        if (!head.keep_alive || response_body_.mode() == BodyFramer::Mode::UntilClose)
+            client_keep_alive_ = false;
+        response_pos_ += response_body_.consume(data + response_pos_, response_end_ - response_pos_);
+        forward_response(begin, response_pos_);
+        return;
+    }
+
+    size_t begin = response_pos_;
+    response_pos_ += response_body_.consume(data + response_pos_, response_end_ - response_pos_);
+    forward_response(begin, response_pos_);
+}
+
+void HttpSession::forward_response(size_t begin, size_t end) {
+    response_started_ = true;
+    auto self = shared_from_this();
+    unsigned attempt = attempt_;
+    boost::asio::async_write(client_, boost::asio::buffer(response_buf_.data() + begin, end - begin),
+        [this, self, attempt](const boost::system::error_code& ec, std::size_t) {
+            if (closed_ || attempt != attempt_) return;
+            if (ec) {
+                close();
+                return;
+            }
+            if (tunnel_) {
+                start_tunnel();
+                return;
+            }
+            if (!response_head_done_) {
+                process_response();   // after an interim response
+                return;
+            }
+            if (response_body_.error()) {
+                close();
+                return;
+            }
+            if (response_body_.done()) {
+                // bytes past the response mean the connection is out of sync
+                if (response_pos_ < response_end_) backend_reusable_ = false;
+                on_response_end(false);
+                return;
+            }
+            response_pos_ = response_end_ = 0;
+            read_response();
+        });
+}
+
+void HttpSession::on_response_end(bool backend_closed) {
+    response_done_ = true;
+    if (backend_closed) backend_reusable_ = false;
+    if (!request_done_) {
+        if (request_body_.done()) return;   // last request write still completing
+        // Answered before the body was sent (e.g. 413): the rest of the body
+        // can no longer be framed reliably, so end the connection.
+        client_keep_alive_ = false;
+        backend_reusable_ = false;
+    }
+    finish_exchange();
+}
+
+void HttpSession::on_backend_error(const boost::system::error_code& ec) {
+    ++attempt_;   // ignore the other half of this exchange from now on
+    boost::system::error_code ignored;
+    backend_.close(ignored);
+
+    if (!response_started_ && backend_reused_ && request_resendable_) {
+        // An idle keep-alive connection the backend had already dropped:
+        // replay the (idempotent) request on a fresh connection.
+        BackendHandle backend = lease_.backend();
+        lease_.release();
+        acquire_backend(std::move(backend));
+        return;
+    }
+
+    lease_.report_failure();
+    lease_.release();
+    if (!response_started_) {
+        LOG_ERROR("Backend failed before responding: %s", ec.message().c_str());
+        send_error(kBadGateway);
+        return;
+    }
+    close();   // mid-response: nothing sensible left to tell the client
+}
+
+// ---------------------------------------------------------------------------
+
+void HttpSession::finish_exchange() {
+    ++attempt_;
+    log_access(response_status_);
+    boost::system::error_code ignored;
+    if (backend_reusable_) {
+        pool_.release(lease_.backend(), std::move(backend_));
+    } else {
+        backend_.close(ignored);
+    }
+    lease_.release();
+
+    if (!client_keep_alive_) {
+        client_.shutdown(tcp::socket::shutdown_send, ignored);
+        close();
+        return;
+    }
+    request_begin_ = request_pos_;
+    read_request();
+}
+
+// 101 Switching Protocols / CONNECT: from here on it is an opaque byte stream
+void HttpSession::start_tunnel() {
+    if (!request_done_) {
+        if (!request_body_.done()) {
+            close();   // switched before the body was read, can't frame the rest
+            return;
+        }
+        tunnel_pending_ = true;   // on_request_sent hands off once the write lands
+        return;
+    }
+
+    log_access(response_status_);
+    auto hand_off = [this]() {
+        closed_ = true;   // the relay owns the sockets and the admission slot now
+        start_relay(std::move(client_), std::move(backend_), options_.relay_mode, std::move(lease_),
+                    std::move(ticket_));
+    };
+
+    size_t pending = request_end_ - request_pos_;
+    if (pending == 0) {
+        hand_off();
+        return;
+    }
+    // client bytes that arrived behind the request head go first
+    auto self = shared_from_this();
+    boost::asio::async_write(backend_, boost::asio::buffer(request_buf_.data() + request_pos_, pending),
+        [this, self, hand_off](const boost::system::error_code& ec, std::size_t) {
+            if (closed_) return;
+            if (ec) {
+                close();
+                return;
+            }
+            hand_off();
+        });
+}
+
+void HttpSession::send_error(const char* response) {
+    client_keep_alive_ = false;
+    log_access(std::atoi(response + std::strlen("HTTP/1.1 ")));
+    auto self = shared_from_this();
+    boost::asio::async_write(client_, boost::asio::buffer(response, std::strlen(response)),
+        [this, self](const boost::system::error_code&, std::size_t) {
+            boost::system::error_code ignored;
+            client_.shutdown(tcp::socket::shutdown_send, ignored);
+            close();
+        });
+}
+
+// One access-log record per request
+void HttpSession::log_access(int status) {
+    if (!Logger::instance().access_enabled()) return;
+    double duration_ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - request_start_).count();
+    // path last: a record too long for the log ring loses only its tail
+    LOG_ACCESS("client=%s:%u backend=%s method=%s status=%d duration_ms=%.3f "
+               "to_backend=%llu from_backend=%llu path=%s",
+               peer_.address().to_string().c_str(), peer_.port(),
+               lease_.backend() ? lease_.backend()->name.c_str() : "-",
+               access_method_.empty() ? "-" : access_method_.c_str(), status, duration_ms,
+               static_cast<unsigned long long>(lease_.bytes_to_backend()),
+               static_cast<unsigned long long>(lease_.bytes_from_backend()),
+               access_target_.empty() ? "-" : access_target_.c_str());
+    access_method_.clear();
+    access_target_.clear();
+}
+
+void HttpSession::close() {
+    if (closed_) return;
+    closed_ = true;
+    boost::system::error_code ignored;
+    client_.shutdown(tcp::socket::shutdown_both, ignored);
+    client_.close(ignored);
+    backend_.close(ignored);
+    lease_.release();
+    ticket_.release();
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "shared_state.h"
+#include "backend_pool.h"
+#include "http_parser.h"
+#include "admission.h"
+
+using boost::asio::ip::tcp;
+
+struct ProxyOptions;
+
+// One client connection in L7 (HTTP/1.1) mode. Requests are framed
+// incrementally in a per-session buffer and forwarded byte-for-byte; each
+// request gets its own choose_backend() decision and runs on a pooled
+// keep-alive backend connection, so a long-lived client is spread across
+// backends instead of pinned to one.
+//
+// Requests are handled one at a time: pipelined requests simply wait in the
+// buffer (or the socket) until the previous response is complete, which
+// keeps responses in order. While a request is in flight its body and the
+// response are pumped concurrently, so Expect: 100-continue and early error
+// responses work. 101 Switching Protocols (and a 2xx to CONNECT) turn the
+// session into a plain TCP tunnel.
+class HttpSession : public std::enable_shared_from_this<HttpSession> {
+public:
+    static constexpr size_t kBufferSize = 64 * 1024;   // also the head size limit
+
+    HttpSession(boost::asio::io_context& io_context, tcp::socket client, SharedState& state,
+                BackendPool& pool, const ProxyOptions& options, uint64_t hash_key,
+                AdmissionTicket ticket = {});
+
+    void start();
+
+private:
+    // request side
+    void read_request();
+    void on_request_head(const HttpHead& head);
+    void acquire_backend(BackendHandle backend);
+    void on_backend(tcp::socket socket, BackendHandle backend, bool reused);
+    void send_request();
+    void read_request_body();
+    void on_request_sent();
+
+    // response side
+    void read_response();
+    void process_response();
+    void forward_response(size_t begin, size_t end);
+    void on_response_end(bool backend_closed);
+    void on_backend_error(const boost::system::error_code& ec);
+
+    void finish_exchange();
+    void start_tunnel();
+    void send_error(const char* response);
+    void log_access(int status);
+    void close();
+
+    boost::asio::io_context& io_context_;
+    tcp::socket client_;
+    tcp::socket backend_;
+    SharedState& state_;
+    BackendPool& pool_;
+    const ProxyOptions& options_;
+    uint64_t hash_key_;
+    BackendLease lease_;                 // backend of the current request
+    AdmissionTicket ticket_;             // the client connection's admission slot
+    tcp::endpoint peer_;                 // client address, for the access log
+
+    // Client bytes: [request_begin_, request_pos_) is the current request as
+    // far as it has been framed, [request_pos_, request_end_) is unread.
+    std::vector<char> request_buf_;
+    size_t request_begin_ = 0;
+    size_t request_pos_ = 0;
+    size_t request_end_ = 0;
+    size_t request_scanned_ = 0;
+    BodyFramer request_body_;
+    bool request_resendable_ = false;    // idempotent, whole request still in the buffer
+    bool head_request_ = false;
+    bool connect_request_ = false;
+    bool upgrade_request_ = false;
+    bool client_keep_alive_ = true;
+    std::chrono::steady_clock::time_point request_start_{};
+    std::string access_method_;          // copied only when the access log is on
+    std::string access_target_;
+
+    // Backend bytes: [0, response_end_) valid, parsed up to response_pos_
+    std::vector<char> response_buf_;
+    size_t response_pos_ = 0;
+    size_t response_end_ = 0;
+    size_t response_scanned_ = 0;
+    BodyFramer response_body_;
+    bool response_head_done_ = false;
+    bool response_started_ = false;      // forwarded a byte to the client
+    int response_status_ = 0;
+    bool backend_reusable_ = false;
+    bool backend_reused_ = false;
+    bool tunnel_ = false;
+    bool tunnel_pending_ = false;        // switched while the request write is in flight
+
+    bool request_done_ = false;
+    bool response_done_ = false;
+    bool first_byte_seen_ = false;
+    unsigned attempt_ = 0;               // bumped when backend handlers go stale
+    std::chrono::steady_clock::time_point request_sent_{};
+    bool closed_ = false;
+};
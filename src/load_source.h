@@ -0,0 +1,20 @@
+#pragma once
+
+// A background sampler that feeds per-target load and health into
+// SharedState. Implementations pick their own targets up from
+// SharedState::snapshot(), so they follow membership changes on their own.
+class LoadSource {
+public:
+    virtual ~LoadSource() = default;
+
+    virtual void start() = 0;
+    virtual void stop() = 0;
+};
+
+// No sampling: targets stay healthy at 0% CPU. For benchmarks and hosts
+// without Docker or cgroup v2 ("load_source: none").
+class StaticLoadSource : public LoadSource {
+public:
+    void start() override {}
+    void stop() override {}
+};
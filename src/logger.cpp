@@ -0,0 +1,197 @@
+#include "logger.h"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+LogLevel parse_log_level(const std::string& name) {
+    if (name == "debug") return LogLevel::Debug;
+    if (name == "info") return LogLevel::Info;
+    if (name == "warn") return LogLevel::Warn;
+    if (name == "error") return LogLevel::Error;
+    if (name == "off") return LogLevel::Off;
+    throw std::invalid_argument("unknown log_level: " + name);
+}
+
+bool LogRateLimiter::allow(uint32_t limit, uint64_t& suppressed) {
+    int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t window = window_.load(std::memory_order_relaxed);
+    if (window != now && window_.compare_exchange_strong(window, now, std::memory_order_relaxed)) {
+        count_.store(0, std::memory_order_relaxed);
+    }
+    if (count_.fetch_add(1, std::memory_order_relaxed) < limit) {
+        suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+    suppressed_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+// ---------------------------------------------------------------------------
+
+Logger& Logger::instance() {
+    // Leaked on purpose: threads may still log while statics are destroyed
+    static Logger* logger = new Logger();
+    return *logger;
+}
+
+void Logger::set_access_log(const std::string& path) {
+    std::lock_guard<std::mutex> lock(rings_mtx_);
+    if (access_file_ && access_file_ != stdout) std::fclose(access_file_);
+    access_file_ = nullptr;
+    if (path == "-") {
+        access_file_ = stdout;
+    } else if (!path.empty()) {
+        access_file_ = std::fopen(path.c_str(), "a");
+        if (!access_file_) throw std::runtime_error("cannot open access_log " + path);
+    }
+    access_enabled_.store(access_file_ != nullptr, std::memory_order_relaxed);
+}
+
+void Logger::start() {
+    if (running_.exchange(true)) return;
+    stopping_ = false;
+    thread_ = std::thread([this]() { run(); });
+}
+
+void Logger::stop() {
+    if (!running_.load()) return;
+    {
+        std::lock_guard<std::mutex> lock(wake_mtx_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+    running_.store(false);
+    drain();   // anything logged while the thread was finishing
+}
+
+void Logger::write(LogLevel level, uint64_t suppressed, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    append(level, false, suppressed, format, args);
+    va_end(args);
+}
+
+void Logger::access(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    append(LogLevel::Info, true, 0, format, args);
+    va_end(args);
+}
+
+void Logger::append(LogLevel level, bool access, uint64_t suppressed, const char* format, va_list args) {
+    LogRecord stack_record;
+    LogRing* ring = nullptr;
+    LogRecord* record = &stack_record;
+    if (running_.load(std::memory_order_relaxed)) {
+        ring = local_ring();
+        record = ring->claim();
+        if (!record) {
+            ring->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    record->time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    record->level = level;
+    record->access = access;
+    constexpr size_t kLimit = LogRecord::kMaxText - 1;
+    int n = std::vsnprintf(record->text, LogRecord::kMaxText, format, args);
+    bool cut = n > static_cast<int>(kLimit);
+    size_t length = n < 0 ? 0 : std::min<size_t>(n, kLimit);
+    if (suppressed > 0 && !cut) {
+        n = std::snprintf(record->text + length, LogRecord::kMaxText - length,
+                          " (%llu similar suppressed)", static_cast<unsigned long long>(suppressed));
+        cut = length + std::max(n, 0) > kLimit;
+        length = std::min<size_t>(length + std::max(n, 0), kLimit);
+    }
+    if (cut) std::memcpy(record->text + kLimit - 3, "...", 3);   // never silently short
+    record->length = static_cast<uint16_t>(length);
+
+    if (ring) {
+        ring->commit();
+    } else {
+        std::lock_guard<std::mutex> lock(sync_mtx_);
+        emit(*record);
+    }
+}
+
+LogRing* Logger::local_ring() {
+    // Flags the ring when the thread exits; drain() frees it once it has
+    // written what is left (the Logger itself is never destroyed)
+    struct Owner {
+        LogRing* ring = nullptr;
+        ~Owner() {
+            if (ring) ring->retired.store(true, std::memory_order_release);
+        }
+    };
+    thread_local Owner owner;
+    if (!owner.ring) {
+        auto owned = std::make_unique<LogRing>();
+        owner.ring = owned.get();
+        std::lock_guard<std::mutex> lock(rings_mtx_);
+        rings_.push_back(std::move(owned));
+    }
+    return owner.ring;
+}
+
+void Logger::run() {
+    std::unique_lock<std::mutex> lock(wake_mtx_);
+    while (!stopping_) {
+        wake_.wait_for(lock, std::chrono::milliseconds(20), [this]() { return stopping_; });
+        lock.unlock();
+        drain();
+        lock.lock();
+    }
+}
+
+// Merge what every thread has buffered and write it out in time order
+void Logger::drain() {
+    std::vector<LogRecord> batch;
+    uint64_t dropped = 0;
+    {
+        std::lock_guard<std::mutex> lock(rings_mtx_);
+        for (auto& ring : rings_) {
+            // checked first: a retired ring gets no more commits after this
+            bool retired = ring->retired.load(std::memory_order_acquire);
+            ring->drain([&batch](const LogRecord& r) { batch.push_back(r); });
+            dropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+            if (retired) ring.reset();
+        }
+        rings_.erase(std::remove(rings_.begin(), rings_.end(), nullptr), rings_.end());
+
+        std::stable_sort(batch.begin(), batch.end(),
+                         [](const LogRecord& a, const LogRecord& b) { return a.time_us < b.time_us; });
+        for (auto& record : batch) emit(record);
+        // under the lock: a reload may swap access_file_
+        if (!batch.empty() && access_file_) std::fflush(access_file_);
+    }
+
+    if (dropped > 0) {
+        std::fprintf(stderr, "[WARN] %llu log messages dropped (ring full)\n",
+                     static_cast<unsigned long long>(dropped));
+    }
+    if (!batch.empty()) std::fflush(stdout);
+}
+
+void Logger::emit(const LogRecord& record) {
+    if (record.access) {
+        if (!access_file_) return;
+        // ISO 8601 UTC timestamp, then the caller's key=value fields
+        std::time_t seconds = static_cast<std::time_t>(record.time_us / 1000000);
+        std::tm tm{};
+        gmtime_r(&seconds, &tm);
+        char stamp[32];
+        std::strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm);
+        std::fprintf(access_file_, "ts=%s.%06lldZ %.*s\n", stamp,
+                     static_cast<long long>(record.time_us % 1000000), record.length, record.text);
+        return;
+    }
+
+    static const char* const prefixes[] = {"[DEBUG] ", "[INFO] ", "[WARN] ", "[ERROR] "};
+    FILE* out = record.level >= LogLevel::Warn ? stderr : stdout;
+    std::fprintf(out, "%s%.*s\n", prefixes[static_cast<int>(record.level)], record.length, record.text);
+}
@@ -0,0 +1,155 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class LogLevel : uint8_t {
+    Debug,
+    Info,
+    Warn,
+    Error,
+    Off
+};
+
+// Parse "debug" / "info" / "warn" / "error" / "off"; throws std::invalid_argument otherwise.
+LogLevel parse_log_level(const std::string& name);
+
+// One formatted message. Fixed size so a ring slot is written in place
+// with no allocation; longer messages are cut and end in "...", so put
+// variable-length fields (URLs) last.
+struct LogRecord {
+    static constexpr size_t kMaxText = 488;
+
+    int64_t time_us;          // system_clock, for the timestamp
+    LogLevel level;
+    bool access;              // access-log record rather than a log line
+    uint16_t length;
+    char text[kMaxText];
+};
+
+// Single-producer/single-consumer ring: the owning thread appends, the
+// logger thread drains. A full ring drops the message instead of blocking.
+class LogRing {
+public:
+    static constexpr size_t kCapacity = 512;
+
+    LogRecord* claim() {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) >= kCapacity) return nullptr;
+        return &slots_[head % kCapacity];
+    }
+    void commit() { head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    template <typename F>
+    void drain(F&& f) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t head = head_.load(std::memory_order_acquire);
+        for (; tail != head; ++tail) f(slots_[tail % kCapacity]);
+        tail_.store(tail, std::memory_order_release);
+    }
+
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> retired{false};   // owning thread exited; freed once drained
+
+private:
+    std::array<LogRecord, kCapacity> slots_;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+};
+
+// Per call site budget for WARN/ERROR: at most `limit` messages per second,
+// the rest are counted and reported with the next message that gets through.
+class LogRateLimiter {
+public:
+    bool allow(uint32_t limit, uint64_t& suppressed);
+
+private:
+    std::atomic<int64_t> window_{0};     // steady_clock second
+    std::atomic<uint32_t> count_{0};
+    std::atomic<uint64_t> suppressed_{0};
+};
+
+// Process-wide logger. Call sites format straight into their thread's ring
+// (printf-style, no locks, no allocation after the first message); a
+// background thread merges the rings in time order and does the actual
+// writes, so a slow terminal never stalls an io_context. Before start() and
+// after stop() messages are written synchronously instead.
+class Logger {
+public:
+    static Logger& instance();
+
+    static bool enabled(LogLevel level) {
+        return level >= instance().level_.load(std::memory_order_relaxed);
+    }
+    bool access_enabled() const { return access_enabled_.load(std::memory_order_relaxed); }
+    uint32_t rate_limit() const { return rate_limit_.load(std::memory_order_relaxed); }
+
+    void set_level(LogLevel level) { level_.store(level, std::memory_order_relaxed); }
+    void set_rate_limit(uint32_t per_second) { rate_limit_.store(per_second, std::memory_order_relaxed); }
+    // Structured per-session records; "" disables, "-" is stdout
+    void set_access_log(const std::string& path);
+
+    void start();
+    void stop();   // drains everything still buffered
+
+    void write(LogLevel level, uint64_t suppressed, const char* format, ...)
+        __attribute__((format(printf, 4, 5)));
+    void access(const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+private:
+    Logger() = default;   // never destroyed, see instance()
+
+    void append(LogLevel level, bool access, uint64_t suppressed, const char* format, va_list args);
+    LogRing* local_ring();
+    void run();
+    void drain();
+    void emit(const LogRecord& record);
+
+    std::atomic<LogLevel> level_{LogLevel::Info};
+    std::atomic<uint32_t> rate_limit_{10};
+    std::atomic<bool> access_enabled_{false};
+    std::atomic<bool> running_{false};
+
+    std::mutex rings_mtx_;                         // registration and drain
+    std::vector<std::unique_ptr<LogRing>> rings_;  // one per live thread that has logged
+    std::mutex wake_mtx_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::thread thread_;
+    FILE* access_file_ = nullptr;
+    std::mutex sync_mtx_;                          // synchronous fallback writes
+};
+
+#define LB_LOG(level, ...)                                                    \
+    do {                                                                      \
+        if (Logger::enabled(level)) Logger::instance().write(level, 0, __VA_ARGS__); \
+    } while (0)
+
+#define LB_LOG_LIMITED(level, ...)                                            \
+    do {                                                                      \
+        if (Logger::enabled(level)) {                                         \
+            static LogRateLimiter lb_log_limiter;                             \
+            uint64_t lb_log_suppressed = 0;                                   \
+            if (lb_log_limiter.allow(Logger::instance().rate_limit(), lb_log_suppressed)) \
+                Logger::instance().write(level, lb_log_suppressed, __VA_ARGS__); \
+        }                                                                     \
+    } while (0)
+
+#define LOG_DEBUG(...) LB_LOG(LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(...)  LB_LOG(LogLevel::Info, __VA_ARGS__)
+#define LOG_WARN(...)  LB_LOG_LIMITED(LogLevel::Warn, __VA_ARGS__)
+#define LOG_ERROR(...) LB_LOG_LIMITED(LogLevel::Error, __VA_ARGS__)
+
+#define LOG_ACCESS(...)                                                       \
+    do {                                                                      \
+        if (Logger::instance().access_enabled()) Logger::instance().access(__VA_ARGS__); \
+    } while (0)
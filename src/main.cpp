@@ -1,46 +1,242 @@
 #include "proxy_server.h"
 #include "shared_state.h"
+#include "strategy.h"
 #include "docker_monitor.h"
-#include <yaml-cpp/yaml.h>
+#include "cgroup_monitor.h"
+#include "admin_server.h"
+#include "logger.h"
+#include "config.h"
+#include "health_checker.h"
+#ifdef LB_HAVE_IO_URING
+#include "uring_proxy_server.h"
+#endif
 #include <iostream>
 #include <thread>
 #include <atomic>
 #include <csignal>
+#include <memory>
+#include <vector>
+#include <algorithm>
 #include <boost/asio.hpp>
+#include <curl/curl.h>
 
 std::atomic<bool> stop_flag{false};
+std::atomic<bool> reload_flag{false};
 void handle_sigint(int) { stop_flag.store(true); }
+void handle_sighup(int) { reload_flag.store(true); }
+
+static const char* const kConfigPath = "config.yaml";
+
+static std::unique_ptr<LoadSource> make_load_source(const LbConfig& config, SharedState& state) {
+    if (config.load_source == "docker")
+        return std::make_unique<DockerMonitor>(state, config.monitor_interval, config.docker_socket);
+    if (config.load_source == "cgroup")
+        return std::make_unique<CgroupMonitor>(state, std::chrono::milliseconds(config.cgroup_sample_ms),
+                                               config.cgroup_root);
+    return std::make_unique<StaticLoadSource>();
+}
+
+static void apply_logging(const LbConfig& config, bool reopen_access_log) {
+    Logger& logger = Logger::instance();
+    logger.set_level(config.log_level);
+    logger.set_rate_limit(config.log_rate_limit);
+    if (reopen_access_log) logger.set_access_log(config.access_log);
+}
+
+// splice() is probed at runtime; fall back the same way at startup and on reload
+static bool fit_relay_mode(LbConfig& config) {
+    if (config.proxy.relay_mode != RelayMode::Splice || splice_supported()) return false;
+    config.proxy.relay_mode = RelayMode::Buffered;
+    return true;
+}
+
+// io_uring only relays L4 and needs the build option and a recent kernel;
+// otherwise run on asio. Returns why it fell back, or nullptr.
+static const char* fit_io_backend(LbConfig& config) {
+    if (config.proxy.io_backend != IoBackend::IoUring) return nullptr;
+    const char* reason = nullptr;
+    if (config.proxy.mode != ProxyMode::Tcp) {
+        reason = "io_uring backend is tcp mode only";
+    } else {
+#ifdef LB_HAVE_IO_URING
+        if (!io_uring_unavailable_reason().empty()) reason = io_uring_unavailable_reason().c_str();
+#else
+        reason = "built without LB_WITH_IO_URING";
+#endif
+    }
+    if (reason) config.proxy.io_backend = IoBackend::Asio;
+    return reason;
+}
+
+static bool same_proxy_options(const ProxyOptions& a, const ProxyOptions& b) {
+    return a.mode == b.mode && a.io_backend == b.io_backend && a.relay_mode == b.relay_mode
+        && a.hash_key == b.hash_key
+        && a.connect.timeout == b.connect.timeout && a.connect.max_attempts == b.connect.max_attempts
+        && a.pool.max_idle_per_backend == b.pool.max_idle_per_backend
+        && a.pool.idle_timeout == b.pool.idle_timeout;
+}
+
+static const char* health_label(const TargetInfo& t) {
+    if (!t.healthy.load()) return "DOWN";
+    if (!t.probe_healthy.load()) return "FAILING";   // active health check
+    switch (t.circuit.load()) {
+    case CircuitState::Open: return "EJECTED";
+    case CircuitState::HalfOpen: return "TRIAL";
+    default: return "OK";
+    }
+}
+
+// Re-read config.yaml and apply everything that can change without a
+// restart. The workers never wait on this: the new backend set is published
+// as a single table swap, and retired backends drain as their sessions end.
+// Runs on the main thread only.
+static void reload(LbConfig& current, SharedState& state, AdmissionController& admission,
+                   std::unique_ptr<LoadSource>& monitor, std::unique_ptr<HealthChecker>& health) {
+    LbConfig next;
+    try {
+        next = load_config(kConfigPath);
+        fit_relay_mode(next);
+        fit_io_backend(next);
+    } catch (const std::exception& ex) {
+        LOG_ERROR("Reload failed, keeping the running config: %s", ex.what());
+        return;
+    }
+
+    TargetChanges changes;
+    try {
+        changes = state.set_targets(next.targets);
+    } catch (const std::exception& ex) {
+        LOG_ERROR("Reload failed, keeping the running config: %s", ex.what());
+        return;
+    }
+    for (auto& name : changes.added) LOG_INFO("Reload: added target %s", name.c_str());
+    for (auto& name : changes.replaced) LOG_INFO("Reload: replaced target %s (old one draining)", name.c_str());
+    for (auto& name : changes.removed) LOG_INFO("Reload: removed target %s (draining)", name.c_str());
+
+    if (next.strategy != current.strategy
+        || next.strategy_options.peak_ewma_decay != current.strategy_options.peak_ewma_decay
+        || next.strategy_options.maglev_table_size != current.strategy_options.maglev_table_size) {
+        state.set_strategy(next.strategy, next.strategy_options);
+        LOG_INFO("Reload: strategy %s", next.strategy.c_str());
+    }
+    if (next.ewma_alpha != current.ewma_alpha) state.set_ewma_alpha(next.ewma_alpha);
+
+    state.set_outlier_options(next.outlier);
+    state.set_backend_connection_limit(next.admission.max_connections_per_backend);
+    admission.set_options(next.admission);
+    if (health_check_changed(current, next)) {
+        health->stop();
+        health = std::make_unique<HealthChecker>(state, next.health_check);
+        health->start();
+        LOG_INFO("Reload: health checker restarted");
+    }
+
+    if (load_source_changed(current, next)) {
+        monitor->stop();
+        monitor = make_load_source(next, state);
+        monitor->start();
+        LOG_INFO("Reload: load source %s restarted", next.load_source.c_str());
+    }
+
+    try {
+        apply_logging(next, next.access_log != current.access_log);
+    } catch (const std::exception& ex) {
+        LOG_ERROR("Reload: %s", ex.what());
+        next.access_log = current.access_log;
+    }
+
+    // Bound to sockets and threads that already exist
+    if (next.listen_port != current.listen_port) LOG_WARN("Reload: listen_port change needs a restart");
+    if (next.worker_threads != current.worker_threads) LOG_WARN("Reload: worker_threads change needs a restart");
+    if (next.admin_port != current.admin_port) LOG_WARN("Reload: admin_port change needs a restart");
+    if (!same_proxy_options(next.proxy, current.proxy))
+        LOG_WARN("Reload: proxy, relay, io, connect and pool settings need a restart");
+    next.listen_port = current.listen_port;
+    next.worker_threads = current.worker_threads;
+    next.admin_port = current.admin_port;
+    next.proxy = current.proxy;
+
+    current = std::move(next);
+    LOG_INFO("Reload complete: %zu target(s)", current.targets.size());
+}
 
 int main() {
     signal(SIGINT, handle_sigint);
+    signal(SIGHUP, handle_sighup);
 
     try {
-        // Load YAML config
-        YAML::Node config = YAML::LoadFile("config.yaml");
-        int listen_port = config["listen_port"].as<int>();
-        int monitor_interval = config["monitor_interval_seconds"].as<int>();
-        std::string strategy = config["strategy"] ? config["strategy"].as<std::string>() : "least_cpu";
+        LbConfig config = load_config(kConfigPath);
+        // Logging first, so everything after startup goes through the async logger
+        Logger& logger = Logger::instance();
+        apply_logging(config, true);
+        logger.start();
+
+        if (fit_relay_mode(config))
+            std::cout << "[WARN] splice() unavailable, falling back to buffered relay\n";
+        if (const char* reason = fit_io_backend(config))
+            std::cout << "[WARN] " << reason << ", falling back to the asio backend\n";
 
         SharedState state;
-        state.set_strategy(strategy);  // ✅ tell SharedState which mode to use
+        state.set_strategy(config.strategy, config.strategy_options);  // ✅ tell SharedState which mode to use
+        state.set_ewma_alpha(config.ewma_alpha);
+        state.set_outlier_options(config.outlier);
+        state.set_backend_connection_limit(config.admission.max_connections_per_backend);
+        AdmissionController admission(config.admission);
+        state.set_targets(config.targets);
+        for (auto& t : config.targets)
+            std::cout << "[Config] Added " << t.name << " on " << t.host << ":" << t.port << "\n";
 
-        for (const auto& node : config["targets"]) {
-            std::string name = node["name"].as<std::string>();
-            int port = node["host_port"].as<int>();
-            state.add_target(name, "127.0.0.1", port);
-            std::cout << "[Config] Added " << name << " on 127.0.0.1:" << port << "\n";
-        }
+        std::cout << "[INFO] Load-balancing strategy: " << config.strategy << "\n";
+        std::cout << "[INFO] Proxy mode: "
+                  << (config.proxy.mode == ProxyMode::Http ? "http" : "tcp") << "\n";
+        std::cout << "[INFO] Relay mode: "
+                  << (config.proxy.relay_mode == RelayMode::Splice ? "splice" : "buffered") << "\n";
+        std::cout << "[INFO] IO backend: "
+                  << (config.proxy.io_backend == IoBackend::IoUring ? "io_uring" : "asio") << "\n";
 
-        std::cout << "[INFO] Load-balancing strategy: " << strategy << "\n";
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+        std::unique_ptr<LoadSource> monitor = make_load_source(config, state);
+        std::cout << "[INFO] Load source: " << config.load_source << "\n";
+        monitor->start();
 
-        DockerMonitor monitor(state, monitor_interval);
-        monitor.start();
+        auto health = std::make_unique<HealthChecker>(state, config.health_check);
+        health->start();
 
-        boost::asio::io_context io_context;
-        ProxyServer server(io_context, listen_port, state);
-        std::cout << "[INFO] Listening on port " << listen_port << "\n";
+        // One io_context + SO_REUSEPORT acceptor per worker thread (or one
+        // ring + listener each with the io_uring backend)
+        std::vector<std::unique_ptr<boost::asio::io_context>> contexts;
+        std::vector<std::unique_ptr<ProxyServer>> servers;
+#ifdef LB_HAVE_IO_URING
+        std::vector<std::unique_ptr<UringProxyServer>> uring_servers;
+        if (config.proxy.io_backend == IoBackend::IoUring)
+            for (int i = 0; i < config.worker_threads; ++i)
+                uring_servers.push_back(std::make_unique<UringProxyServer>(config.listen_port, state, admission,
+                                                                           config.proxy));
+#endif
+        for (int i = 0; config.proxy.io_backend == IoBackend::Asio && i < config.worker_threads; ++i) {
+            contexts.push_back(std::make_unique<boost::asio::io_context>(1));
+            servers.push_back(std::make_unique<ProxyServer>(*contexts.back(), config.listen_port, state, admission,
+                                                          config.proxy));
+            servers.back()->start_accept();
+        }
+        std::cout << "[INFO] Listening on port " << config.listen_port
+                  << " with " << config.worker_threads << " worker thread(s)\n";
 
-        server.start_accept();
+        // Optional local stats endpoint, on its own thread
+        int admin_port = config.admin_port;
+        boost::asio::io_context admin_context(1);
+        std::unique_ptr<AdminServer> admin;
+        std::thread admin_thread;
+        if (admin_port > 0) {
+            admin = std::make_unique<AdminServer>(admin_context, admin_port, state, admission);
+            admin->start_accept();
+            admin_thread = std::thread([&admin_context]() {
+                while (!stop_flag.load()) {
+                    admin_context.run_for(std::chrono::milliseconds(200));
+                }
+            });
+            std::cout << "[INFO] Metrics on http://127.0.0.1:" << admin_port << "/metrics\n";
+        }
 
         // CLI loop
         std::thread cli_thread([&]() {
@@ -54,26 +250,79 @@ int main() {
                     break;
                 }
 
+                if (cmd == "reload") {
+                    reload_flag.store(true);   // applied by the main thread, same as SIGHUP
+                    continue;
+                }
+
                 if (cmd == "status") {
                     auto snap = state.snapshot();
-                    std::cout << "NAME\tPORT\tHEALTH\tCPU%\n";
+                    std::cout << "NAME\tPORT\tHEALTH\tCPU%\tEWMA%\tACTIVE\tLAT(ms)\tMEM(MB)\tPSI%\n";
                     for (auto& t : snap)
                         std::cout << t.name << "\t" << t.port << "\t"
-                                  << (t.healthy ? "OK" : "DOWN") << "\t"
-                                  << t.cpu_percent.load() << "\n";
+                                  << health_label(t) << "\t"
+                                  << t.cpu_percent.load() << "\t"
+                                  << t.cpu_ewma.load() << "\t"
+                                  << t.active_connections.load() << "\t"
+                                  << t.latency_ewma_us.load() / 1000.0 << "\t"
+                                  << t.memory_bytes.load() / (1024 * 1024) << "\t"
+                                  << t.cpu_pressure.load() << "\n";
+
+                    // traffic since startup; latencies as p50/p99 in ms
+                    auto ms = [](const HistogramSnapshot& h, double q) { return h.percentile(q) / 1000.0; };
+                    std::cout << "NAME\tCONNS\tFAIL\tTX(MB)\tRX(MB)\tCONNECT\tTTFB\tSESSION\n";
+                    for (auto& t : snap) {
+                        BackendMetrics m = state.metrics(t);
+                        std::cout << t.name << "\t" << m.connections << "\t" << m.connect_failures << "\t"
+                                  << m.bytes_to_backend / (1024.0 * 1024.0) << "\t"
+                                  << m.bytes_from_backend / (1024.0 * 1024.0) << "\t"
+                                  << ms(m.connect_us, 0.5) << "/" << ms(m.connect_us, 0.99) << "\t"
+                                  << ms(m.first_byte_us, 0.5) << "/" << ms(m.first_byte_us, 0.99) << "\t"
+                                  << ms(m.session_us, 0.5) << "/" << ms(m.session_us, 0.99) << "\n";
+                    }
+                    using Reject = AdmissionController::Reject;
+                    std::cout << "Clients: " << admission.active() << " connected, " << admission.pending()
+                              << " waiting; rejected " << admission.rejected(Reject::Limit) << " at the limit, "
+                              << admission.rejected(Reject::QueueFull) << " queue full, "
+                              << admission.rejected(Reject::QueueTimeout) << " timed out\n";
                 }
             }
         });
 
-        // main event loop
+        // worker event loops
+        std::vector<std::thread> workers;
+        for (auto& ctx : contexts) {
+            boost::asio::io_context* io = ctx.get();
+            workers.emplace_back([io]() {
+                while (!stop_flag.load()) {
+                    io->run_for(std::chrono::milliseconds(200));
+                }
+            });
+        }
+#ifdef LB_HAVE_IO_URING
+        for (auto& server : uring_servers) {
+            UringProxyServer* s = server.get();
+            workers.emplace_back([s]() { s->run(stop_flag); });
+        }
+#endif
+
+        // Main thread: apply reloads (SIGHUP or the CLI) until shutdown
         while (!stop_flag.load()) {
-            io_context.run_for(std::chrono::milliseconds(200));
+            if (reload_flag.exchange(false)) reload(config, state, admission, monitor, health);
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
         }
 
-        monitor.stop();
+        for (auto& w : workers) w.join();
+        if (admin_thread.joinable()) admin_thread.join();
+
+        health->stop();
+        monitor->stop();
         cli_thread.join();
+        curl_global_cleanup();
+        logger.stop();
         std::cout << "[INFO] Graceful shutdown complete.\n";
     } catch (const std::exception& ex) {
+        Logger::instance().stop();
         std::cerr << "[FATAL] " << ex.what() << std::endl;
         return 1;
     }
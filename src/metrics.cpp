@@ -0,0 +1,110 @@
+#include "metrics.h"
+
+int Histogram::bucket_of(uint64_t value) {
+    if (value < static_cast<uint64_t>(kSubBuckets)) return static_cast<int>(value);
+    int exponent = 63 - __builtin_clzll(value);
+    if (exponent > kMaxExponent) return kBuckets - 1;
+    int sub = static_cast<int>((value >> (exponent - kSubBits)) & (kSubBuckets - 1));
+    return (exponent - kSubBits + 1) * kSubBuckets + sub;
+}
+
+uint64_t Histogram::upper_bound(int bucket) {
+    if (bucket < kSubBuckets) return static_cast<uint64_t>(bucket) + 1;
+    int exponent = bucket / kSubBuckets - 1 + kSubBits;
+    uint64_t sub = static_cast<uint64_t>(bucket % kSubBuckets);
+    uint64_t width = uint64_t{1} << (exponent - kSubBits);
+    return ((kSubBuckets + sub) << (exponent - kSubBits)) + width;
+}
+
+void HistogramSnapshot::add(const HistogramCounts& h) {
+    for (int i = 0; i < Histogram::kBuckets; ++i) {
+        uint64_t n = h.count(i);
+        counts[i] += n;
+        count += n;
+    }
+    sum += h.sum();
+}
+
+uint64_t HistogramSnapshot::percentile(double q) const {
+    if (count == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(count - 1)) + 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < Histogram::kBuckets; ++i) {
+        seen += counts[i];
+        if (seen >= rank) return Histogram::upper_bound(i);
+    }
+    return Histogram::upper_bound(Histogram::kBuckets - 1);
+}
+
+// ---------------------------------------------------------------------------
+
+// Registries are told apart by serial rather than address, so a thread's
+// cached slots can never leak into a registry reallocated at the same spot.
+static std::atomic<uint64_t> next_registry_serial{1};
+
+namespace {
+struct LocalCache {
+    uint64_t serial = 0;
+    void* slots = nullptr;
+};
+thread_local LocalCache local_cache;
+}  // namespace
+
+MetricsRegistry::MetricsRegistry() : serial_(next_registry_serial.fetch_add(1)) {}
+
+MetricsRegistry::~MetricsRegistry() {
+    for (auto& thread : threads_)
+        for (auto& slot : thread->slots) delete slot.load();
+}
+
+BackendCounters* MetricsRegistry::local(uint32_t backend_id) {
+    if (backend_id >= kMaxBackendIds) return nullptr;
+
+    ThreadSlots* slots = local_cache.serial == serial_
+        ? static_cast<ThreadSlots*>(local_cache.slots) : register_thread();
+
+    BackendCounters* counters = slots->slots[backend_id].load(std::memory_order_relaxed);
+    if (!counters) {
+        counters = new BackendCounters();
+        slots->slots[backend_id].store(counters, std::memory_order_release);
+    }
+    return counters;
+}
+
+// Slow path: the cache holds another registry (or nothing) for this thread
+MetricsRegistry::ThreadSlots* MetricsRegistry::register_thread() {
+    std::thread::id self = std::this_thread::get_id();
+    ThreadSlots* raw = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        for (auto& thread : threads_)
+            if (thread->owner == self) raw = thread.get();
+        if (!raw) {
+            threads_.push_back(std::make_unique<ThreadSlots>());
+            raw = threads_.back().get();
+            raw->owner = self;
+        }
+    }
+    local_cache.serial = serial_;
+    local_cache.slots = raw;
+    return raw;
+}
+
+BackendMetrics MetricsRegistry::collect(uint32_t backend_id) const {
+    BackendMetrics out;
+    if (backend_id >= kMaxBackendIds) return out;
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (auto& thread : threads_) {
+        const BackendCounters* c = thread->slots[backend_id].load(std::memory_order_acquire);
+        if (!c) continue;
+        out.connections += c->connections.load(std::memory_order_relaxed);
+        out.connect_failures += c->connect_failures.load(std::memory_order_relaxed);
+        out.bytes_to_backend += c->bytes_to_backend.load(std::memory_order_relaxed);
+        out.bytes_from_backend += c->bytes_from_backend.load(std::memory_order_relaxed);
+        out.connect_us.add(c->connect_us);
+        out.first_byte_us.add(c->first_byte_us);
+        out.session_us.add(c->session_us);
+    }
+    return out;
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Log-linear latency histogram in the style of HdrHistogram: each power of
+// two is split into kSubBuckets linear buckets, so any recorded value lands
+// in a bucket no wider than 1/kSubBuckets of itself (12.5% here). Values are
+// microseconds; anything past 2^kMaxExponent is clamped into the last bucket.
+struct Histogram {
+    static constexpr int kSubBits = 3;
+    static constexpr int kSubBuckets = 1 << kSubBits;
+    static constexpr int kMaxExponent = 40;   // ~12 days in us
+    static constexpr int kBuckets = (kMaxExponent - kSubBits + 1) * kSubBuckets;
+
+    static int bucket_of(uint64_t value);
+    // Exclusive upper bound of a bucket, i.e. every value in it is < this
+    static uint64_t upper_bound(int bucket);
+};
+
+// Counter update for single-writer counters: a relaxed load+store instead of
+// fetch_add, so the hot path never issues a locked instruction.
+inline void counter_add(std::atomic<uint64_t>& counter, uint64_t by) {
+    counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+}
+
+// One thread's view of a histogram; only the owning thread writes.
+class HistogramCounts {
+public:
+    void record(uint64_t value) {
+        counter_add(counts_[Histogram::bucket_of(value)], 1);
+        counter_add(sum_, value);
+    }
+
+    uint64_t count(int bucket) const { return counts_[bucket].load(std::memory_order_relaxed); }
+    uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+
+private:
+    std::array<std::atomic<uint64_t>, Histogram::kBuckets> counts_{};
+    std::atomic<uint64_t> sum_{0};
+};
+
+// Summed over all threads
+struct HistogramSnapshot {
+    std::array<uint64_t, Histogram::kBuckets> counts{};
+    uint64_t count = 0;
+    uint64_t sum = 0;
+
+    void add(const HistogramCounts& h);
+    // Upper bound of the bucket holding quantile q in [0, 1]; 0 when empty
+    uint64_t percentile(double q) const;
+};
+
+// Per-thread, per-backend counters (written by one worker thread only)
+struct BackendCounters {
+    std::atomic<uint64_t> connections{0};       // sessions opened (BackendLease)
+    std::atomic<uint64_t> connect_failures{0};
+    std::atomic<uint64_t> bytes_to_backend{0};
+    std::atomic<uint64_t> bytes_from_backend{0};
+    HistogramCounts connect_us;
+    HistogramCounts first_byte_us;
+    HistogramCounts session_us;
+};
+
+struct BackendMetrics {
+    uint64_t connections = 0;
+    uint64_t connect_failures = 0;
+    uint64_t bytes_to_backend = 0;
+    uint64_t bytes_from_backend = 0;
+    HistogramSnapshot connect_us;
+    HistogramSnapshot first_byte_us;
+    HistogramSnapshot session_us;
+};
+
+// Owner of every thread's counters. A thread registers itself the first time
+// it records anything and gets a flat table of per-backend slots indexed by
+// TargetInfo::id; a slot is allocated the first time that thread touches
+// that backend. Slots are never freed while the registry lives, so readers
+// can walk them without coordinating with the writers.
+class MetricsRegistry {
+public:
+    static constexpr uint32_t kMaxBackendIds = 4096;   // ids past this are not recorded
+
+    MetricsRegistry();
+    ~MetricsRegistry();
+    MetricsRegistry(const MetricsRegistry&) = delete;
+    MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+    // This thread's counters for `backend_id`, or nullptr if out of range
+    BackendCounters* local(uint32_t backend_id);
+
+    // Sum of all threads; safe to call from any thread at any time
+    BackendMetrics collect(uint32_t backend_id) const;
+
+private:
+    struct ThreadSlots {
+        std::thread::id owner;
+        std::array<std::atomic<BackendCounters*>, kMaxBackendIds> slots{};
+    };
+
+    ThreadSlots* register_thread();
+
+    const uint64_t serial_;    // identifies this registry in thread-local caches
+    mutable std::mutex mtx_;   // guards threads_ (registration and collect)
+    std::vector<std::unique_ptr<ThreadSlots>> threads_;
+};
@@ -1,79 +1,233 @@
 #include "proxy_server.h"
-#include <iostream>
+#include "http_session.h"
+#include "logger.h"
+#include <sys/socket.h>
 
 using boost::asio::ip::tcp;
 
-ProxyServer::ProxyServer(boost::asio::io_context& io_context, short listen_port, SharedState& state)
+using reuse_port = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
+// Out of fds or memory: give closing sessions a moment instead of spinning
+static constexpr std::chrono::milliseconds kAcceptBackoff{100};
+// How often the pending queue looks for a free backend
+static constexpr std::chrono::milliseconds kPendingTick{5};
+
+static const char kOverloaded[] =
+    "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nRetry-After: 1\r\nConnection: close\r\n\r\n";
+
+HashKey parse_hash_key(const std::string& name) {
+    if (name == "source_ip") return HashKey::SourceIp;
+    if (name == "source_ip_port") return HashKey::SourceIpPort;
+    throw std::invalid_argument("unknown hash_key: " + name);
+}
+
+ProxyMode parse_proxy_mode(const std::string& name) {
+    if (name == "tcp") return ProxyMode::Tcp;
+    if (name == "http") return ProxyMode::Http;
+    throw std::invalid_argument("unknown proxy_mode: " + name);
+}
+
+IoBackend parse_io_backend(const std::string& name) {
+    if (name == "asio") return IoBackend::Asio;
+    if (name == "io_uring") return IoBackend::IoUring;
+    throw std::invalid_argument("unknown io_backend: " + name);
+}
+
+// splitmix64 finalizer: spreads nearby addresses across the Maglev table
+static uint64_t mix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+ProxyServer::ProxyServer(boost::asio::io_context& io_context, short listen_port, SharedState& state,
+                         AdmissionController& admission, const ProxyOptions& options)
     : io_context_(io_context),
-      acceptor_(io_context, tcp::endpoint(tcp::v4(), listen_port)),
-      state_(state) {}
+      acceptor_(io_context),
+      state_(state),
+      admission_(admission),
+      options_(options),
+      pool_(options.pool),
+      sweep_timer_(io_context),
+      accept_timer_(io_context),
+      pending_timer_(io_context) {
+    // Every worker binds its own acceptor to the same port; SO_REUSEPORT lets
+    // the kernel load-balance new connections between them.
+    tcp::endpoint endpoint(tcp::v4(), listen_port);
+    acceptor_.open(endpoint.protocol());
+    acceptor_.set_option(tcp::acceptor::reuse_address(true));
+    acceptor_.set_option(reuse_port(true));
+    acceptor_.bind(endpoint);
+    acceptor_.listen();
+    if (options_.mode == ProxyMode::Http) schedule_pool_sweep();
+}
 
-void ProxyServer::start_accept() {
-    auto client_socket = std::make_shared<tcp::socket>(io_context_);
+void ProxyServer::schedule_pool_sweep() {
+    sweep_timer_.expires_after(std::chrono::seconds(1));
+    sweep_timer_.async_wait([this](const boost::system::error_code& ec) {
+        if (ec) return;
+        pool_.sweep();
+        schedule_pool_sweep();
+    });
+}
 
-    acceptor_.async_accept(*client_socket, [this, client_socket](const boost::system::error_code& ec) {
+void ProxyServer::start_accept() {
+    acceptor_.async_accept(io_context_, [this](const boost::system::error_code& ec, tcp::socket client_socket) {
         if (!ec) {
-            handle_accept(client_socket);
+            handle_accept(std::move(client_socket));
+        } else if (ec == boost::asio::error::no_descriptors
+                   || ec == boost::system::errc::too_many_files_open_in_system
+                   || ec == boost::asio::error::no_buffer_space || ec == boost::asio::error::no_memory) {
+            // Retrying at once would spin on the same error; new clients
+            // wait in the listen backlog meanwhile
+            LOG_ERROR("Accept failed: %s, pausing accepts", ec.message().c_str());
+            accept_timer_.expires_after(kAcceptBackoff);
+            accept_timer_.async_wait([this](const boost::system::error_code& timer_ec) {
+                if (!timer_ec) start_accept();
+            });
+            return;
         } else {
-            std::cerr << "[ERROR] Accept failed: " << ec.message() << "\n";
+            LOG_ERROR("Accept failed: %s", ec.message().c_str());
         }
         start_accept(); // continue accepting new clients
     });
 }
 
-void ProxyServer::handle_accept(std::shared_ptr<tcp::socket> client_socket) {
-    auto backend_opt = state_.choose_backend();
+uint64_t client_hash_key(const tcp::endpoint& remote, HashKey key) {
+    uint64_t h = 0;
+    auto address = remote.address();
+    if (address.is_v4()) {
+        h = mix64(address.to_v4().to_uint());
+    } else {
+        for (unsigned char byte : address.to_v6().to_bytes()) h = mix64(h ^ byte);
+    }
+    if (key == HashKey::SourceIpPort) h = mix64(h ^ remote.port());
+    return h;
+}
+
+uint64_t ProxyServer::client_hash(const tcp::socket& client) const {
+    boost::system::error_code ec;
+    tcp::endpoint remote = client.remote_endpoint(ec);
+    if (ec) return 0;
+    return client_hash_key(remote, options_.hash_key);
+}
 
-    if (!backend_opt) {
-        std::cerr << "[ERROR] No healthy backend available.\n";
+void ProxyServer::handle_accept(tcp::socket client_socket) {
+    AdmissionTicket ticket = admission_.admit();
+    if (!ticket) {
+        LOG_WARN("Connection limit reached, rejecting client");
+        reject(std::move(client_socket));
         return;
     }
 
-    auto [backend_host, backend_port] = *backend_opt;
-
-    try {
-        auto backend_socket = std::make_shared<tcp::socket>(io_context_);
-        tcp::resolver resolver(io_context_);
-        auto endpoints = resolver.resolve(backend_host, std::to_string(backend_port));
-        boost::asio::connect(*backend_socket, endpoints);
-
-        std::cout << "[INFO] Routing new connection → " 
-                  << backend_host << ":" << backend_port << "\n";
-
-        // Start bidirectional forwarding
-        auto forward = [this](std::shared_ptr<tcp::socket> src, std::shared_ptr<tcp::socket> dst) {
-            auto buffer = std::make_shared<std::vector<char>>(8192);
-            src->async_read_some(boost::asio::buffer(*buffer),
-                [buffer, src, dst, this](boost::system::error_code ec, std::size_t length) {
-                    if (!ec) {
-                        boost::asio::async_write(*dst, boost::asio::buffer(*buffer, length),
-                            [src, dst, buffer](boost::system::error_code write_ec, std::size_t) {
-                                if (!write_ec) {
-                                    // Continue forwarding
-                                    auto self = src;
-                                    auto other = dst;
-                                    auto next_buffer = std::make_shared<std::vector<char>>(8192);
-                                    self->async_read_some(boost::asio::buffer(*next_buffer),
-                                        [next_buffer, self, other](boost::system::error_code e, std::size_t len) {
-                                            if (!e) {
-                                                boost::asio::async_write(*other, boost::asio::buffer(*next_buffer, len),
-                                                    [self, other, next_buffer](boost::system::error_code, std::size_t) {});
-                                            }
-                                        });
-                                }
-                            });
-                    }
-                });
-        };
-
-        // Start bidirectional relay
-        forward(client_socket, backend_socket);
-        forward(backend_socket, client_socket);
-
-    } catch (const std::exception& e) {
-        std::cerr << "[ERROR] Failed to connect to backend (" 
-                  << backend_host << ":" << backend_port << "): "
-                  << e.what() << "\n";
+    if (options_.mode == ProxyMode::Http) {
+        // Backends are chosen per request inside the session
+        boost::system::error_code ignored;
+        client_socket.set_option(tcp::no_delay(true), ignored);
+        uint64_t hash = client_hash(client_socket);
+        std::make_shared<HttpSession>(io_context_, std::move(client_socket), state_, pool_, options_, hash,
+                                      std::move(ticket))
+            ->start();
+        return;
     }
+
+    SelectionContext selection;
+    selection.hash_key = client_hash(client_socket);
+    auto client = std::make_shared<PendingClient>(
+        PendingClient{std::move(client_socket), selection, std::move(ticket)});
+    if (!pending_.empty()) {
+        enqueue(std::move(client));   // no overtaking clients that are already waiting
+        return;
+    }
+    connect_client(std::move(client), nullptr);
+}
+
+void ProxyServer::connect_client(std::shared_ptr<PendingClient> client, BackendHandle preferred) {
+    BackendConnector::connect(io_context_, state_, options_.connect, client->selection,
+        [this, client](const boost::system::error_code& ec, tcp::socket backend_socket, BackendHandle backend) {
+            if (ec) {
+                if (!backend) {
+                    // every backend down or at its limit: wait for a slot
+                    enqueue(client);
+                    return;
+                }
+                LOG_ERROR("Failed to connect to backend (%s:%d): %s",
+                          backend->host.c_str(), backend->port, ec.message().c_str());
+                boost::system::error_code ignored;
+                client->socket.close(ignored);
+                return;
+            }
+
+            LOG_DEBUG("Routing new connection → %s:%d", backend->host.c_str(), backend->port);
+
+            boost::system::error_code ignored;
+            client->socket.set_option(tcp::no_delay(true), ignored);
+            backend_socket.set_option(tcp::no_delay(true), ignored);
+
+            // Start bidirectional relay
+            start_relay(std::move(client->socket), std::move(backend_socket), options_.relay_mode,
+                        BackendLease(state_, std::move(backend)), std::move(client->ticket));
+        },
+        std::move(preferred));
+}
+
+void ProxyServer::enqueue(std::shared_ptr<PendingClient> client) {
+    if (!admission_.try_enqueue()) {
+        LOG_ERROR("No backend available and the pending queue is full, rejecting client");
+        reject(std::move(client->socket));
+        return;
+    }
+    client->deadline = std::chrono::steady_clock::now() + admission_.pending_timeout();
+    pending_.push_back(std::move(client));
+    if (pending_.size() == 1) schedule_pending();
 }
 
+void ProxyServer::schedule_pending() {
+    pending_timer_.expires_after(kPendingTick);
+    pending_timer_.async_wait([this](const boost::system::error_code& ec) {
+        if (ec) return;
+        drain_pending();
+        if (!pending_.empty()) schedule_pending();
+    });
+}
+
+// Oldest first: hand out whatever backend capacity has freed up, and give up
+// on clients that waited too long
+void ProxyServer::drain_pending() {
+    auto now = std::chrono::steady_clock::now();
+    while (!pending_.empty()) {
+        std::shared_ptr<PendingClient> client = pending_.front();
+        if (now >= client->deadline) {
+            pending_.pop_front();
+            admission_.dequeue();
+            admission_.count_reject(AdmissionController::Reject::QueueTimeout);
+            LOG_ERROR("No backend available within pending_timeout, rejecting client");
+            reject(std::move(client->socket));
+            continue;
+        }
+        // the connect attempt counts against the backend's limit right away,
+        // so the next pick in this loop already sees it
+        BackendHandle backend = state_.choose_backend(client->selection);
+        if (!backend) break;
+        pending_.pop_front();
+        admission_.dequeue();
+        connect_client(std::move(client), std::move(backend));
+    }
+}
+
+// Turn a client away without tying up anything
+void ProxyServer::reject(tcp::socket client) {
+    boost::system::error_code ignored;
+    if (options_.mode != ProxyMode::Http) {
+        client.close(ignored);
+        return;
+    }
+    auto socket = std::make_shared<tcp::socket>(std::move(client));
+    boost::asio::async_write(*socket, boost::asio::buffer(kOverloaded, sizeof(kOverloaded) - 1),
+        [socket](const boost::system::error_code&, std::size_t) {
+            boost::system::error_code ignored;
+            socket->shutdown(tcp::socket::shutdown_send, ignored);
+            socket->close(ignored);
+        });
+}
@@ -1,23 +1,98 @@
 #pragma once
 #include <boost/asio.hpp>
+#include <chrono>
+#include <deque>
 #include <memory>
 #include <functional>
 
 #include "shared_state.h"
+#include "relay_session.h"
+#include "backend_connector.h"
+#include "backend_pool.h"
+#include "admission.h"
 
 using boost::asio::ip::tcp;
 
+// What the consistent_hash strategy keys clients on
+enum class HashKey {
+    SourceIp,       // all connections from one address stick together
+    SourceIpPort    // per-connection spread, still deterministic
+};
+
+// Parse "source_ip" / "source_ip_port"; throws std::invalid_argument otherwise.
+HashKey parse_hash_key(const std::string& name);
+
+// SelectionContext::hash_key for a client address
+uint64_t client_hash_key(const tcp::endpoint& remote, HashKey key);
+
+enum class ProxyMode {
+    Tcp,    // L4: one backend per client connection, bytes relayed blindly
+    Http    // L7: HTTP/1.1 requests balanced individually over pooled connections
+};
+
+// Parse "tcp" / "http"; throws std::invalid_argument otherwise.
+ProxyMode parse_proxy_mode(const std::string& name);
+
+enum class IoBackend {
+    Asio,      // epoll reactor, ProxyServer
+    IoUring    // tcp mode only, UringProxyServer (built with LB_WITH_IO_URING)
+};
+
+// Parse "asio" / "io_uring"; throws std::invalid_argument otherwise.
+IoBackend parse_io_backend(const std::string& name);
+
+// Data-plane settings shared by all worker ProxyServers
+struct ProxyOptions {
+    ProxyMode mode = ProxyMode::Tcp;
+    IoBackend io_backend = IoBackend::Asio;
+    RelayMode relay_mode = RelayMode::Buffered;
+    ConnectOptions connect;
+    HashKey hash_key = HashKey::SourceIp;
+    PoolOptions pool;
+};
+
+// One ProxyServer runs per worker thread. Each owns its own io_context and a
+// SO_REUSEPORT acceptor on the shared listen port, so the kernel spreads
+// incoming connections across workers and every connection stays on the
+// thread that accepted it.
+//
+// Overload handling: a client over max_connections is rejected as soon as
+// it is accepted (closed in tcp mode, a 503 in http mode). An L4 client that
+// finds every backend down or at its connection limit waits in this
+// worker's pending queue, first come first served, until a backend frees up
+// or pending_timeout passes.
 class ProxyServer {
 public:
-    ProxyServer(boost::asio::io_context& io_context, short listen_port, SharedState& state);
+    ProxyServer(boost::asio::io_context& io_context, short listen_port, SharedState& state,
+                AdmissionController& admission, const ProxyOptions& options = {});
     void start_accept();
 
 private:
-    void handle_accept(std::shared_ptr<tcp::socket> client_socket);
-    std::pair<std::string,int> get_backend_from_state();
+    // An admitted L4 client on its way to a backend
+    struct PendingClient {
+        tcp::socket socket;
+        SelectionContext selection;
+        AdmissionTicket ticket;
+        std::chrono::steady_clock::time_point deadline{};
+    };
+
+    void handle_accept(tcp::socket client_socket);
+    void connect_client(std::shared_ptr<PendingClient> client, BackendHandle preferred);
+    void enqueue(std::shared_ptr<PendingClient> client);
+    void schedule_pending();
+    void drain_pending();
+    void reject(tcp::socket client);
+    void schedule_pool_sweep();
+    uint64_t client_hash(const tcp::socket& client) const;
 
     boost::asio::io_context& io_context_;
     tcp::acceptor acceptor_;
     SharedState& state_;
+    AdmissionController& admission_;
+    ProxyOptions options_;
+    BackendPool pool_;   // L7 keep-alive connections of this worker
+    boost::asio::steady_timer sweep_timer_;
+    boost::asio::steady_timer accept_timer_;    // accept backoff when out of fds
+    boost::asio::steady_timer pending_timer_;
+    std::deque<std::shared_ptr<PendingClient>> pending_;
 };
-
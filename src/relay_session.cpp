@@ -0,0 +1,279 @@
+#include "relay_session.h"
+#include "logger.h"
+#include <stdexcept>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+RelayMode parse_relay_mode(const std::string& name) {
+    if (name == "buffered") return RelayMode::Buffered;
+    if (name == "splice") return RelayMode::Splice;
+    throw std::invalid_argument("unknown relay_mode: " + name);
+}
+
+tcp::endpoint access_log_peer(const tcp::socket& client) {
+    if (!Logger::instance().access_enabled()) return {};
+    boost::system::error_code ignored;
+    return client.remote_endpoint(ignored);
+}
+
+void log_session(const tcp::endpoint& peer, const BackendLease& lease) {
+    if (!Logger::instance().access_enabled() || !lease.backend()) return;
+    double duration_ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - lease.opened()).count();
+    LOG_ACCESS("client=%s:%u backend=%s duration_ms=%.3f to_backend=%llu from_backend=%llu",
+               peer.address().to_string().c_str(), peer.port(), lease.backend()->name.c_str(), duration_ms,
+               static_cast<unsigned long long>(lease.bytes_to_backend()),
+               static_cast<unsigned long long>(lease.bytes_from_backend()));
+}
+
+bool splice_supported() {
+    static const bool supported = [] {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return false;
+        int fds[2];
+        if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0) {
+            ::close(sv[0]);
+            ::close(sv[1]);
+            return false;
+        }
+        char byte = 0;
+        bool ok = ::write(sv[0], &byte, 1) == 1
+               && splice(sv[1], nullptr, fds[1], nullptr, 1, SPLICE_F_NONBLOCK) == 1;
+        ::close(sv[0]);
+        ::close(sv[1]);
+        ::close(fds[0]);
+        ::close(fds[1]);
+        return ok;
+    }();
+    return supported;
+}
+
+void start_relay(tcp::socket client, tcp::socket backend, RelayMode mode, BackendLease lease,
+                 AdmissionTicket ticket) {
+    if (mode == RelayMode::Splice && splice_supported()) {
+        auto session = std::make_shared<SpliceRelaySession>(std::move(client), std::move(backend),
+                                                            std::move(lease), std::move(ticket));
+        if (session->open_pipes()) {
+            session->start();
+            return;
+        }
+        // out of pipes/fds: relay this connection through user space instead
+        client = std::move(session->client());
+        backend = std::move(session->backend());
+        lease = std::move(session->lease());
+        ticket = std::move(session->ticket());
+    }
+    std::make_shared<RelaySession>(std::move(client), std::move(backend), std::move(lease),
+                                   std::move(ticket))->start();
+}
+
+RelaySession::RelaySession(tcp::socket client, tcp::socket backend, BackendLease lease,
+                           AdmissionTicket ticket)
+    : client_(std::move(client)),
+      backend_(std::move(backend)),
+      upstream_(client_, backend_),
+      downstream_(backend_, client_),
+      lease_(std::move(lease)),
+      ticket_(std::move(ticket)),
+      peer_(access_log_peer(client_)) {}
+
+void RelaySession::start() {
+    read(upstream_);
+    read(downstream_);
+}
+
+void RelaySession::read(Direction& dir) {
+    auto self = shared_from_this();
+    dir.from.async_read_some(boost::asio::buffer(dir.buffer),
+        [this, self, &dir](const boost::system::error_code& ec, std::size_t length) {
+            if (closed_) return;
+            if (ec == boost::asio::error::eof) {
+                finish(dir);
+                return;
+            }
+            if (ec) {
+                if (&dir.from == &backend_) lease_.report_failure();   // reset by the backend
+                close();
+                return;
+            }
+            if (&dir == &upstream_) {
+                first_byte_.on_upstream_data();
+                lease_.report_bytes(length, 0);
+            } else {
+                first_byte_.on_downstream_data(lease_);
+                lease_.report_bytes(0, length);
+            }
+            write(dir, length);
+        });
+}
+
+void RelaySession::write(Direction& dir, std::size_t length) {
+    auto self = shared_from_this();
+    boost::asio::async_write(dir.to, boost::asio::buffer(dir.buffer.data(), length),
+        [this, self, &dir](const boost::system::error_code& ec, std::size_t) {
+            if (closed_) return;
+            if (ec) {
+                if (&dir.to == &backend_) lease_.report_failure();
+                close();
+                return;
+            }
+            read(dir);
+        });
+}
+
+// Source reached EOF: pass the half-close on and wait for the other direction.
+void RelaySession::finish(Direction& dir) {
+    dir.done = true;
+    boost::system::error_code ignored;
+    dir.to.shutdown(tcp::socket::shutdown_send, ignored);
+    if (upstream_.done && downstream_.done) close();
+}
+
+void RelaySession::close() {
+    if (closed_) return;
+    closed_ = true;
+    log_session(peer_, lease_);
+    boost::system::error_code ignored;
+    client_.shutdown(tcp::socket::shutdown_both, ignored);
+    client_.close(ignored);
+    backend_.shutdown(tcp::socket::shutdown_both, ignored);
+    backend_.close(ignored);
+    lease_.release();
+    ticket_.release();
+}
+
+// ---------------------------------------------------------------------------
+// SpliceRelaySession
+
+SpliceRelaySession::SpliceRelaySession(tcp::socket client, tcp::socket backend, BackendLease lease,
+                                       AdmissionTicket ticket)
+    : client_(std::move(client)),
+      backend_(std::move(backend)),
+      upstream_(client_, backend_),
+      downstream_(backend_, client_),
+      lease_(std::move(lease)),
+      ticket_(std::move(ticket)),
+      peer_(access_log_peer(client_)) {}
+
+SpliceRelaySession::~SpliceRelaySession() {
+    for (Direction* dir : {&upstream_, &downstream_}) {
+        if (dir->pipe_read >= 0) ::close(dir->pipe_read);
+        if (dir->pipe_write >= 0) ::close(dir->pipe_write);
+    }
+}
+
+bool SpliceRelaySession::open_pipes() {
+    for (Direction* dir : {&upstream_, &downstream_}) {
+        int fds[2];
+        if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0) return false;
+        dir->pipe_read = fds[0];
+        dir->pipe_write = fds[1];
+        fcntl(dir->pipe_write, F_SETPIPE_SZ, static_cast<int>(kPipeSize));
+    }
+    // splice() honours the socket's own O_NONBLOCK, not just SPLICE_F_NONBLOCK
+    boost::system::error_code ec;
+    client_.native_non_blocking(true, ec);
+    if (!ec) backend_.native_non_blocking(true, ec);
+    return !ec;
+}
+
+void SpliceRelaySession::start() {
+    pump(upstream_);
+    pump(downstream_);
+}
+
+// Move as much as the sockets allow without blocking, then park on the reactor
+// until the side we are stuck on becomes ready again.
+void SpliceRelaySession::pump(Direction& dir) {
+    std::size_t moved = 0;
+    while (!closed_) {
+        if (dir.in_pipe > 0) {
+            ssize_t n = splice(dir.pipe_read, nullptr, dir.to.native_handle(), nullptr,
+                               dir.in_pipe, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0) {
+                dir.in_pipe -= static_cast<std::size_t>(n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && errno == EAGAIN) {
+                wait(dir, dir.to, tcp::socket::wait_write);
+                return;
+            }
+            if (&dir.to == &backend_) lease_.report_failure();
+            close();
+            return;
+        }
+
+        if (dir.eof) {
+            finish(dir);
+            return;
+        }
+
+        if (moved >= kBudgetPerRun) {
+            // let other sessions on this worker run
+            auto self = shared_from_this();
+            boost::asio::post(client_.get_executor(), [this, self, &dir]() { pump(dir); });
+            return;
+        }
+
+        ssize_t n = splice(dir.from.native_handle(), nullptr, dir.pipe_write, nullptr,
+                           kPipeSize, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            dir.in_pipe = static_cast<std::size_t>(n);
+            moved += dir.in_pipe;
+            if (&dir == &upstream_) {
+                first_byte_.on_upstream_data();
+                lease_.report_bytes(dir.in_pipe, 0);
+            } else {
+                first_byte_.on_downstream_data(lease_);
+                lease_.report_bytes(0, dir.in_pipe);
+            }
+        } else if (n == 0) {
+            dir.eof = true;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN) {
+            wait(dir, dir.from, tcp::socket::wait_read);
+            return;
+        } else {
+            if (&dir.from == &backend_) lease_.report_failure();
+            close();
+            return;
+        }
+    }
+}
+
+void SpliceRelaySession::wait(Direction& dir, tcp::socket& socket, tcp::socket::wait_type type) {
+    auto self = shared_from_this();
+    socket.async_wait(type, [this, self, &dir, &socket](const boost::system::error_code& ec) {
+        if (closed_) return;
+        if (ec) {
+            if (&socket == &backend_) lease_.report_failure();
+            close();
+            return;
+        }
+        pump(dir);
+    });
+}
+
+void SpliceRelaySession::finish(Direction& dir) {
+    dir.done = true;
+    boost::system::error_code ignored;
+    dir.to.shutdown(tcp::socket::shutdown_send, ignored);
+    if (upstream_.done && downstream_.done) close();
+}
+
+void SpliceRelaySession::close() {
+    if (closed_) return;
+    closed_ = true;
+    log_session(peer_, lease_);
+    boost::system::error_code ignored;
+    client_.shutdown(tcp::socket::shutdown_both, ignored);
+    client_.close(ignored);
+    backend_.shutdown(tcp::socket::shutdown_both, ignored);
+    backend_.close(ignored);
+    lease_.release();
+    ticket_.release();
+}
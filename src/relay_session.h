@@ -0,0 +1,156 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "shared_state.h"
+#include "admission.h"
+
+using boost::asio::ip::tcp;
+
+enum class RelayMode {
+    Buffered,   // async_read_some/async_write through a user-space buffer
+    Splice      // splice() through a per-direction pipe (Linux, zero-copy)
+};
+
+// Parse "buffered" / "splice"; throws std::invalid_argument otherwise.
+RelayMode parse_relay_mode(const std::string& name);
+
+// True if the kernel lets us splice() from a socket into a pipe (probed once).
+bool splice_supported();
+
+// Start relaying between a connected client/backend pair using `mode`,
+// falling back to the buffered relay when splice cannot be set up. The lease
+// and the admission ticket are held until the session ends. Any connected
+// stream sockets will do: two socketpair() ends assigned to tcp::sockets
+// exercise the relay, half-close and splice paths without a network.
+void start_relay(tcp::socket client, tcp::socket backend, RelayMode mode, BackendLease lease,
+                 AdmissionTicket ticket = {});
+
+// Client address for access-log records; looked up only when the access log
+// is enabled, since the peer may be gone by the time the record is written.
+tcp::endpoint access_log_peer(const tcp::socket& client);
+
+// One access-log record per relayed connection, written as it closes
+void log_session(const tcp::endpoint& peer, const BackendLease& lease);
+
+// Measures time from the client's first bytes to the backend's first reply
+// and reports it once through the lease. Connections where the backend
+// speaks first produce no sample. The first reply also counts as a passive
+// health success for the backend.
+class FirstByteTimer {
+public:
+    void on_upstream_data() {
+        if (start_ == std::chrono::steady_clock::time_point{}) start_ = std::chrono::steady_clock::now();
+    }
+
+    void on_downstream_data(BackendLease& lease) {
+        if (done_) return;
+        done_ = true;
+        lease.report_success();
+        if (start_ == std::chrono::steady_clock::time_point{}) return;
+        lease.report_latency(LatencyKind::FirstByte,
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_));
+    }
+
+private:
+    std::chrono::steady_clock::time_point start_{};
+    bool done_ = false;
+};
+
+// Full-duplex TCP relay between an accepted client and its backend.
+// Each direction loops read -> write until EOF; an EOF is propagated to the
+// other side as a half-close (shutdown send), and any error tears down both
+// sockets. Buffers live inside the session so relaying does not allocate
+// per chunk. A direction only reads again once its write has completed, so
+// a slow receiver stalls its sender through TCP flow control rather than
+// growing a buffer here.
+class RelaySession : public std::enable_shared_from_this<RelaySession> {
+public:
+    static constexpr std::size_t kBufferSize = 16 * 1024;
+
+    RelaySession(tcp::socket client, tcp::socket backend, BackendLease lease = {},
+                 AdmissionTicket ticket = {});
+
+    void start();
+
+private:
+    struct Direction {
+        tcp::socket& from;
+        tcp::socket& to;
+        std::array<char, kBufferSize> buffer;
+        bool done = false;
+
+        Direction(tcp::socket& f, tcp::socket& t) : from(f), to(t) {}
+    };
+
+    void read(Direction& dir);
+    void write(Direction& dir, std::size_t length);
+    void finish(Direction& dir);
+    void close();
+
+    tcp::socket client_;
+    tcp::socket backend_;
+    Direction upstream_;    // client -> backend
+    Direction downstream_;  // backend -> client
+    BackendLease lease_;
+    AdmissionTicket ticket_;
+    FirstByteTimer first_byte_;
+    tcp::endpoint peer_;    // client address, for the access log
+    bool closed_ = false;
+};
+
+// Zero-copy variant of RelaySession: bytes move socket -> pipe -> socket with
+// splice(2) and never enter user space. Readiness still comes from the asio
+// reactor via async_wait, so sessions share the worker's event loop with the
+// buffered ones. Same EOF/half-close/error semantics as RelaySession.
+class SpliceRelaySession : public std::enable_shared_from_this<SpliceRelaySession> {
+public:
+    static constexpr std::size_t kPipeSize = 64 * 1024;
+    // Bytes moved per direction before yielding back to the event loop
+    static constexpr std::size_t kBudgetPerRun = 4 * kPipeSize;
+
+    SpliceRelaySession(tcp::socket client, tcp::socket backend, BackendLease lease = {},
+                       AdmissionTicket ticket = {});
+    ~SpliceRelaySession();
+
+    // Create the pipes; on failure the sockets are left untouched so the
+    // caller can hand them to a RelaySession instead.
+    bool open_pipes();
+    void start();
+
+    tcp::socket& client() { return client_; }
+    tcp::socket& backend() { return backend_; }
+    BackendLease& lease() { return lease_; }
+    AdmissionTicket& ticket() { return ticket_; }
+
+private:
+    struct Direction {
+        tcp::socket& from;
+        tcp::socket& to;
+        int pipe_read = -1;
+        int pipe_write = -1;
+        std::size_t in_pipe = 0;   // bytes buffered in the pipe, not yet sent
+        bool eof = false;
+        bool done = false;
+
+        Direction(tcp::socket& f, tcp::socket& t) : from(f), to(t) {}
+    };
+
+    void pump(Direction& dir);
+    void wait(Direction& dir, tcp::socket& socket, tcp::socket::wait_type type);
+    void finish(Direction& dir);
+    void close();
+
+    tcp::socket client_;
+    tcp::socket backend_;
+    Direction upstream_;    // client -> backend
+    Direction downstream_;  // backend -> client
+    BackendLease lease_;
+    AdmissionTicket ticket_;
+    FirstByteTimer first_byte_;
+    tcp::endpoint peer_;    // client address, for the access log
+    bool closed_ = false;
+};
@@ -1,19 +1,178 @@
 #include "shared_state.h"
+#include "strategy.h"
+#include "logger.h"
 #include <algorithm>
-#include <limits>
+#include <boost/asio.hpp>
 
-void SharedState::add_target(const std::string& name, const std::string& host, int port) {
+// A half-open trial that never reported back (e.g. the client left before
+// sending anything) stops blocking the next one after this long
+static constexpr int64_t kTrialTimeoutNs = 10'000'000'000;
+
+static int64_t steady_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Let one connection at a time through to a half-open backend
+static bool claim_trial(TargetInfo& t) {
+    if (t.circuit.load(std::memory_order_acquire) != CircuitState::HalfOpen) return true;
+    int64_t now = steady_now_ns();
+    int64_t claimed = t.trial_claimed_ns.load(std::memory_order_relaxed);
+    if (claimed != 0 && now - claimed < kTrialTimeoutNs) return false;
+    return t.trial_claimed_ns.compare_exchange_strong(claimed, now, std::memory_order_relaxed);
+}
+
+static bool admits(TargetInfo& t, int connection_limit) {
+    if (connection_limit > 0
+        && t.active_connections.load(std::memory_order_relaxed) + t.connecting.load(std::memory_order_relaxed)
+               >= connection_limit) {
+        return false;
+    }
+    return claim_trial(t);
+}
+
+// Literal addresses are used as-is; names go through the resolver once
+static boost::asio::ip::tcp::endpoint resolve_endpoint(const std::string& host, int port) {
+    boost::system::error_code ec;
+    auto address = boost::asio::ip::make_address(host, ec);
+    if (!ec) return {address, static_cast<unsigned short>(port)};
+
+    boost::asio::io_context io;
+    boost::asio::ip::tcp::resolver resolver(io);
+    auto results = resolver.resolve(host, std::to_string(port));   // throws on failure
+    return results.begin()->endpoint();
+}
+
+BackendLease::BackendLease(SharedState& state, BackendHandle backend)
+    : state_(&state), backend_(std::move(backend)), opened_(std::chrono::steady_clock::now()) {
+    if (backend_) state_->report_connection_open(*backend_);
+}
+
+BackendLease::~BackendLease() {
+    release();
+}
+
+BackendLease& BackendLease::operator=(BackendLease&& other) noexcept {
+    if (this != &other) {
+        release();
+        state_ = other.state_;
+        backend_ = std::move(other.backend_);
+        opened_ = other.opened_;
+        bytes_to_backend_ = other.bytes_to_backend_;
+        bytes_from_backend_ = other.bytes_from_backend_;
+    }
+    return *this;
+}
+
+void BackendLease::report_latency(LatencyKind kind, std::chrono::microseconds latency) {
+    if (backend_) state_->report_latency(*backend_, kind, latency);
+}
+
+void BackendLease::report_bytes(uint64_t to_backend, uint64_t from_backend) {
+    if (!backend_) return;
+    bytes_to_backend_ += to_backend;
+    bytes_from_backend_ += from_backend;
+    state_->report_bytes(*backend_, to_backend, from_backend);
+}
+
+void BackendLease::report_success() {
+    if (backend_) state_->report_backend_success(*backend_);
+}
+
+void BackendLease::report_failure() {
+    if (backend_) state_->report_backend_failure(*backend_);
+}
+
+void BackendLease::release() {
+    if (backend_) {
+        state_->report_connection_close(*backend_,
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - opened_));
+    }
+    backend_.reset();
+}
+
+SharedState::SharedState() : strategy_(make_strategy("least_cpu")) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    publish_table();
+}
+
+SharedState::~SharedState() = default;
+
+SharedState::BackendTable::~BackendTable() = default;
+
+void SharedState::add_target(const std::string& name, const std::string& host, int port,
+                             const std::string& cgroup_path) {
     std::lock_guard<std::mutex> lock(mtx_);
-    TargetInfo t;
-    t.name = name;
-    t.host = host;
-    t.port = port;
-    t.cpu_percent = 0.0;
-    t.healthy = true;
+    auto t = std::make_shared<TargetInfo>(name, host, port);
+    t->id = id_for(name);
+    t->endpoint = resolve_endpoint(host, port);
+    t->cgroup_path = cgroup_path;
+    t->cpu_percent = 0.0;
+    t->healthy = true;
     targets_.push_back(std::move(t));
+    publish_table();
+}
+
+// A target keeps its metrics slot across reloads, replacements and
+// re-adds, so reload churn does not use up MetricsRegistry ids
+uint32_t SharedState::id_for(const std::string& name) {
+    auto [it, added] = ids_.emplace(name, static_cast<uint32_t>(ids_.size()));
+    if (added && it->second == MetricsRegistry::kMaxBackendIds)
+        LOG_WARN("More than %u distinct target names; metrics are not recorded for new ones",
+                 MetricsRegistry::kMaxBackendIds);
+    return it->second;
+}
+
+TargetChanges SharedState::set_targets(const std::vector<TargetSpec>& specs) {
+    // resolve first, outside the lock: it may block, and it may throw
+    std::vector<boost::asio::ip::tcp::endpoint> endpoints;
+    endpoints.reserve(specs.size());
+    for (auto& spec : specs) endpoints.push_back(resolve_endpoint(spec.host, spec.port));
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    TargetChanges changes;
+    std::vector<BackendHandle> next;
+    next.reserve(specs.size());
+    for (size_t i = 0; i < specs.size(); ++i) {
+        const TargetSpec& spec = specs[i];
+        auto it = std::find_if(targets_.begin(), targets_.end(),
+                               [&](const BackendHandle& t) { return t->name == spec.name; });
+        if (it != targets_.end() && (*it)->host == spec.host && (*it)->port == spec.port
+            && (*it)->cgroup_path == spec.cgroup_path) {
+            next.push_back(*it);
+            continue;
+        }
+        auto t = std::make_shared<TargetInfo>(spec.name, spec.host, spec.port);
+        t->id = id_for(spec.name);
+        t->endpoint = endpoints[i];
+        t->cgroup_path = spec.cgroup_path;
+        t->healthy = true;
+        next.push_back(std::move(t));
+        (it != targets_.end() ? changes.replaced : changes.added).push_back(spec.name);
+    }
+
+    for (auto& t : targets_) {
+        if (std::find(next.begin(), next.end(), t) != next.end()) continue;
+        t->retired.store(true);
+        bool still_configured = std::any_of(specs.begin(), specs.end(),
+                                            [&](const TargetSpec& s) { return s.name == t->name; });
+        if (!still_configured) changes.removed.push_back(t->name);
+    }
+
+    targets_ = std::move(next);
+    publish_table();
+    return changes;
 }
 
 std::vector<TargetInfo> SharedState::snapshot() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    std::vector<TargetInfo> copy;
+    copy.reserve(targets_.size());
+    for (auto& t : targets_) copy.push_back(*t);
+    return copy;
+}
+
+std::vector<BackendHandle> SharedState::targets() {
     std::lock_guard<std::mutex> lock(mtx_);
     return targets_;
 }
@@ -21,49 +180,206 @@ std::vector<TargetInfo> SharedState::snapshot() {
 void SharedState::update_target_stats(const std::string& name, double cpu_percent, bool healthy) {
     std::lock_guard<std::mutex> lock(mtx_);
     for (auto &t : targets_) {
-        if (t.name == name) {
-            t.cpu_percent.store(cpu_percent);
-            t.healthy.store(healthy);
+        if (t->name == name) {
+            t->cpu_percent.store(cpu_percent);
+            // seed the average with the first real sample
+            double prev = t->cpu_ewma.load();
+            t->cpu_ewma.store(prev == 0.0 ? cpu_percent : ewma_alpha_ * cpu_percent + (1.0 - ewma_alpha_) * prev);
+            if (t->healthy.exchange(healthy) != healthy) publish_table();
             return;
         }
     }
     // not found → ignore
 }
 
+void SharedState::update_target_resources(const std::string& name, uint64_t memory_bytes, double cpu_pressure) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (auto &t : targets_) {
+        if (t->name == name) {
+            t->memory_bytes.store(memory_bytes);
+            t->cpu_pressure.store(cpu_pressure);
+            return;
+        }
+    }
+}
+
 void SharedState::set_strategy(const std::string& strategy) {
+    set_strategy(strategy, StrategyOptions{});
+}
+
+void SharedState::set_strategy(const std::string& strategy, const StrategyOptions& options) {
+    std::shared_ptr<BalancingStrategy> next = make_strategy(strategy, options);
     std::lock_guard<std::mutex> lock(mtx_);
-    strategy_ = strategy;
+    strategy_ = std::move(next);
+    publish_table();
 }
 
-std::optional<std::pair<std::string,int>> SharedState::choose_backend() {
+void SharedState::set_ewma_alpha(double alpha) {
+    if (!(alpha > 0.0 && alpha <= 1.0)) throw std::invalid_argument("ewma_alpha must be in (0, 1]");
     std::lock_guard<std::mutex> lock(mtx_);
-    if (targets_.empty()) return std::nullopt;
+    ewma_alpha_ = alpha;
+}
 
-    // keep only healthy
-    std::vector<TargetInfo*> healthy_targets;
+void SharedState::set_outlier_options(const OutlierOptions& options) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    outlier_ = options;
+    if (outlier_.consecutive_failures == 0) {
+        // detection turned off: put everything ejected back
+        for (auto& t : targets_) t->circuit.store(CircuitState::Closed);
+    }
+    publish_table();
+}
+
+void SharedState::set_backend_connection_limit(int limit) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    connection_limit_ = std::max(0, limit);
+    publish_table();
+}
+
+void SharedState::set_probe_health(TargetInfo& target, bool healthy) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (target.probe_healthy.exchange(healthy) != healthy) publish_table();
+}
+
+void SharedState::expire_ejections() {
+    int64_t now = steady_now_ns();
+    std::lock_guard<std::mutex> lock(mtx_);
+    bool changed = false;
     for (auto& t : targets_) {
-        if (t.healthy.load()) healthy_targets.push_back(&t);
+        if (t->circuit.load() != CircuitState::Open || now < t->ejected_until_ns.load()) continue;
+        t->trial_claimed_ns.store(0);
+        t->consecutive_failures.store(0);
+        t->circuit.store(CircuitState::HalfOpen);
+        changed = true;
+        LOG_INFO("Backend %s half-open, letting a trial connection through", t->name.c_str());
     }
-    if (healthy_targets.empty()) return std::nullopt;
+    if (changed) publish_table();
+}
 
-    // ----- ROUND ROBIN -----
-    if (strategy_ == "round_robin") {
-        TargetInfo* target = healthy_targets[rr_index_ % healthy_targets.size()];
-        rr_index_ = (rr_index_ + 1) % healthy_targets.size();
-        return std::make_pair(target->host, target->port);
+void SharedState::publish_table() {
+    auto table = std::make_unique<BackendTable>();
+    for (auto& t : targets_) {
+        if (!t->routable()) continue;
+        table->healthy.push_back(t);
+        if (t->circuit.load() == CircuitState::HalfOpen) table->half_open = true;
     }
+    table->strategy = strategy_;
+    table->outlier = outlier_;
+    table->connection_limit = connection_limit_;
+    table->prepared = strategy_->prepare(table->healthy);
+    table_.publish(std::move(table));
+}
 
-    // ----- LEAST CPU -----
-    TargetInfo* best = nullptr;
-    double best_cpu = std::numeric_limits<double>::infinity();
-    for (auto* t : healthy_targets) {
-        double c = t->cpu_percent.load();
-        if (!best || c < best_cpu) {
-            best = t;
-            best_cpu = c;
-        }
+void SharedState::report_connection_open(TargetInfo& target) {
+    target.active_connections.fetch_add(1, std::memory_order_relaxed);
+    if (BackendCounters* c = metrics_.local(target.id)) counter_add(c->connections, 1);
+    auto table = table_.read();
+    table->strategy->on_connection_open(target);
+}
+
+void SharedState::report_connection_close(TargetInfo& target, std::chrono::microseconds duration) {
+    target.active_connections.fetch_sub(1, std::memory_order_relaxed);
+    if (BackendCounters* c = metrics_.local(target.id)) c->session_us.record(duration.count());
+    auto table = table_.read();
+    table->strategy->on_connection_close(target);
+}
+
+void SharedState::report_latency(TargetInfo& target, LatencyKind kind, std::chrono::microseconds latency) {
+    if (BackendCounters* c = metrics_.local(target.id)) {
+        HistogramCounts& h = kind == LatencyKind::Connect ? c->connect_us : c->first_byte_us;
+        h.record(latency.count());
+    }
+    auto table = table_.read();
+    table->strategy->on_latency(target, kind, latency);
+}
+
+void SharedState::report_connect_failure(TargetInfo& target) {
+    if (BackendCounters* c = metrics_.local(target.id)) counter_add(c->connect_failures, 1);
+    report_backend_failure(target);
+}
+
+void SharedState::report_bytes(TargetInfo& target, uint64_t to_backend, uint64_t from_backend) {
+    BackendCounters* c = metrics_.local(target.id);
+    if (!c) return;
+    if (to_backend) counter_add(c->bytes_to_backend, to_backend);
+    if (from_backend) counter_add(c->bytes_from_backend, from_backend);
+}
+
+void SharedState::report_backend_success(TargetInfo& target) {
+    // only write when there is something to reset: this runs per response
+    if (target.consecutive_failures.load(std::memory_order_relaxed) != 0)
+        target.consecutive_failures.store(0, std::memory_order_relaxed);
+    if (target.circuit.load(std::memory_order_acquire) != CircuitState::HalfOpen) return;
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (target.circuit.load() != CircuitState::HalfOpen) return;
+    target.circuit.store(CircuitState::Closed);
+    target.trial_claimed_ns.store(0);
+    LOG_INFO("Backend %s recovered, circuit closed", target.name.c_str());
+    publish_table();
+}
+
+void SharedState::report_backend_failure(TargetInfo& target) {
+    // read guard dropped before eject(): publishing waits for readers
+    uint32_t threshold = table_.read()->outlier.consecutive_failures;
+    if (threshold == 0) return;
+    uint32_t failures = target.consecutive_failures.fetch_add(1, std::memory_order_relaxed) + 1;
+    CircuitState circuit = target.circuit.load(std::memory_order_acquire);
+    // a failed trial ejects at once; while open, stragglers change nothing
+    if (circuit == CircuitState::HalfOpen || (circuit == CircuitState::Closed && failures >= threshold)) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        eject(target);
+    }
+}
+
+void SharedState::eject(TargetInfo& target) {
+    if (target.circuit.load() == CircuitState::Open || target.retired.load()) return;
+
+    // Never eject so much that the rest gets swamped, but always allow one:
+    // with one or two targets the percentage alone would never let any go
+    size_t ejected = std::count_if(targets_.begin(), targets_.end(), [](const BackendHandle& t) {
+        return t->circuit.load() == CircuitState::Open;
+    });
+    if (ejected > 0
+        && (ejected + 1) * 100 > static_cast<size_t>(outlier_.max_ejection_percent) * targets_.size()) {
+        target.consecutive_failures.store(0);
+        LOG_WARN("Backend %s is failing but max_ejection_percent is reached, keeping it", target.name.c_str());
+        return;
     }
-    if (best) return std::make_pair(best->host, best->port);
-    return std::nullopt;
+
+    // The backoff starts over once a backend has stayed up for a full max_ejection
+    int64_t now = steady_now_ns();
+    int64_t max_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(outlier_.max_ejection).count();
+    if (now - target.ejected_until_ns.load() > max_ns) target.ejections.store(0);
+    uint32_t n = std::min<uint32_t>(target.ejections.load(), 20);
+    int64_t duration = std::min<int64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(outlier_.base_ejection).count() << n, max_ns);
+    target.ejections.fetch_add(1);
+    target.ejected_until_ns.store(now + duration);
+    target.circuit.store(CircuitState::Open);
+    LOG_WARN("Ejecting backend %s for %lld ms after %u failure(s)", target.name.c_str(),
+             static_cast<long long>(duration / 1000000), target.consecutive_failures.load());
+    publish_table();
 }
 
+BackendHandle SharedState::choose_backend(const SelectionContext& ctx) {
+    auto table = table_.read();
+    if (table->healthy.empty()) return nullptr;
+    const BackendHandle* picked = table->strategy->pick(table->healthy, table->prepared.get(), ctx);
+    if (!picked || (!table->half_open && table->connection_limit == 0)) return picked ? *picked : nullptr;
+
+    // A backend at its connection limit, or a half-open one whose trial slot
+    // is taken, is skipped like a failed one
+    SelectionContext retry = ctx;
+    while (picked && !admits(**picked, table->connection_limit)) {
+        if (retry.excluded_count == SelectionContext::kMaxExcluded) {
+            // out of exclusion slots: settle for any remaining backend with room
+            for (const BackendHandle& t : table->healthy)
+                if (retry.allows(t.get()) && admits(*t, table->connection_limit)) return t;
+            return nullptr;
+        }
+        retry.exclude(picked->get());
+        picked = table->strategy->pick(table->healthy, table->prepared.get(), retry);
+    }
+    return picked ? *picked : nullptr;
+}
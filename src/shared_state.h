@@ -1,18 +1,51 @@
 #pragma once
 #include <string>
+#include <cstdint>
 #include <vector>
 #include <mutex>
 #include <atomic>
 #include <optional>
+#include <unordered_map>
 #include <stdexcept>
 #include <algorithm>
+#include <array>
+#include <memory>
+#include <chrono>
+#include <boost/asio/ip/tcp.hpp>
+
+#include "snapshot_ptr.h"
+#include "metrics.h"
+
+// Passive outlier detection state of a backend (a circuit breaker)
+enum class CircuitState : uint8_t {
+    Closed,     // normal
+    Open,       // ejected: not routed to until the ejection expires
+    HalfOpen    // ejection expired: one trial connection at a time decides
+};
 
 struct TargetInfo {
+    uint32_t id = 0;                           // one per target name, indexes metrics
     std::string name;
     std::string host;
     int port;
+    boost::asio::ip::tcp::endpoint endpoint;   // resolved once in add_target
+    std::string cgroup_path;                   // optional, for CgroupMonitor
     std::atomic<double> cpu_percent{0.0};
     std::atomic<bool> healthy{true};
+    std::atomic<uint64_t> memory_bytes{0};
+    std::atomic<double> cpu_pressure{0.0};     // PSI "some" stall %, cgroup source only
+    std::atomic<double> cpu_ewma{0.0};         // smoothed cpu_percent
+    std::atomic<int> active_connections{0};    // in-flight sessions, see BackendLease
+    std::atomic<int> connecting{0};            // connect attempts in flight, see BackendConnector
+    std::atomic<double> latency_ewma_us{0.0};  // peak_ewma first-byte estimate
+    std::atomic<int64_t> latency_stamp_ns{0};  // steady_clock time of last latency sample
+    std::atomic<bool> retired{false};          // dropped by a reload, draining
+    std::atomic<bool> probe_healthy{true};     // active health check verdict
+    std::atomic<CircuitState> circuit{CircuitState::Closed};
+    std::atomic<uint32_t> consecutive_failures{0};  // passive: connect failures, resets, 5xx
+    std::atomic<uint32_t> ejections{0};        // back-to-back ejections, drives the backoff
+    std::atomic<int64_t> ejected_until_ns{0};  // steady_clock end of the current/last ejection
+    std::atomic<int64_t> trial_claimed_ns{0};  // half-open trial in flight since, 0 = none
 
     TargetInfo() = default;
 
@@ -21,28 +54,79 @@ struct TargetInfo {
 
     // Copy constructor
     TargetInfo(const TargetInfo& other)
-        : name(other.name),
+        : id(other.id),
+          name(other.name),
           host(other.host),
           port(other.port),
+          endpoint(other.endpoint),
+          cgroup_path(other.cgroup_path),
           cpu_percent(other.cpu_percent.load()),
-          healthy(other.healthy.load()) {}
+          healthy(other.healthy.load()),
+          memory_bytes(other.memory_bytes.load()),
+          cpu_pressure(other.cpu_pressure.load()),
+          cpu_ewma(other.cpu_ewma.load()),
+          active_connections(other.active_connections.load()),
+          connecting(other.connecting.load()),
+          latency_ewma_us(other.latency_ewma_us.load()),
+          latency_stamp_ns(other.latency_stamp_ns.load()),
+          retired(other.retired.load()),
+          probe_healthy(other.probe_healthy.load()),
+          circuit(other.circuit.load()),
+          consecutive_failures(other.consecutive_failures.load()),
+          ejections(other.ejections.load()),
+          ejected_until_ns(other.ejected_until_ns.load()),
+          trial_claimed_ns(other.trial_claimed_ns.load()) {}
 
     // Move constructor
     TargetInfo(TargetInfo&& other) noexcept
-        : name(std::move(other.name)),
+        : id(other.id),
+          name(std::move(other.name)),
           host(std::move(other.host)),
           port(other.port),
+          endpoint(other.endpoint),
+          cgroup_path(std::move(other.cgroup_path)),
           cpu_percent(other.cpu_percent.load()),
-          healthy(other.healthy.load()) {}
+          healthy(other.healthy.load()),
+          memory_bytes(other.memory_bytes.load()),
+          cpu_pressure(other.cpu_pressure.load()),
+          cpu_ewma(other.cpu_ewma.load()),
+          active_connections(other.active_connections.load()),
+          connecting(other.connecting.load()),
+          latency_ewma_us(other.latency_ewma_us.load()),
+          latency_stamp_ns(other.latency_stamp_ns.load()),
+          retired(other.retired.load()),
+          probe_healthy(other.probe_healthy.load()),
+          circuit(other.circuit.load()),
+          consecutive_failures(other.consecutive_failures.load()),
+          ejections(other.ejections.load()),
+          ejected_until_ns(other.ejected_until_ns.load()),
+          trial_claimed_ns(other.trial_claimed_ns.load()) {}
 
     // Copy assignment
     TargetInfo& operator=(const TargetInfo& other) {
         if (this != &other) {
+            id = other.id;
             name = other.name;
             host = other.host;
             port = other.port;
+            endpoint = other.endpoint;
+            cgroup_path = other.cgroup_path;
             cpu_percent.store(other.cpu_percent.load());
             healthy.store(other.healthy.load());
+            memory_bytes.store(other.memory_bytes.load());
+            cpu_pressure.store(other.cpu_pressure.load());
+            cpu_ewma.store(other.cpu_ewma.load());
+            active_connections.store(other.active_connections.load());
+            connecting.store(other.connecting.load());
+            latency_ewma_us.store(other.latency_ewma_us.load());
+            latency_stamp_ns.store(other.latency_stamp_ns.load());
+            retired.store(other.retired.load());
+            probe_healthy.store(other.probe_healthy.load());
+            circuit.store(other.circuit.load());
+            consecutive_failures.store(other.consecutive_failures.load());
+            ejections.store(other.ejections.load());
+            ejected_until_ns.store(other.ejected_until_ns.load());
+            trial_claimed_ns.store(other.trial_claimed_ns.load());
         }
         return *this;
     }
@@ -50,39 +134,235 @@ struct TargetInfo {
     // Move assignment
     TargetInfo& operator=(TargetInfo&& other) noexcept {
         if (this != &other) {
+            id = other.id;
             name = std::move(other.name);
             host = std::move(other.host);
             port = other.port;
+            endpoint = other.endpoint;
+            cgroup_path = other.cgroup_path;
             cpu_percent.store(other.cpu_percent.load());
             healthy.store(other.healthy.load());
+            memory_bytes.store(other.memory_bytes.load());
+            cpu_pressure.store(other.cpu_pressure.load());
+            cpu_ewma.store(other.cpu_ewma.load());
+            active_connections.store(other.active_connections.load());
+            connecting.store(other.connecting.load());
+            latency_ewma_us.store(other.latency_ewma_us.load());
+            latency_stamp_ns.store(other.latency_stamp_ns.load());
+            retired.store(other.retired.load());
+            probe_healthy.store(other.probe_healthy.load());
+            circuit.store(other.circuit.load());
+            consecutive_failures.store(other.consecutive_failures.load());
+            ejections.store(other.ejections.load());
+            ejected_until_ns.store(other.ejected_until_ns.load());
+            trial_claimed_ns.store(other.trial_claimed_ns.load());
         }
         return *this;
     }
+
+    // Monitor, active probe and outlier detection all agree it can take traffic
+    bool routable() const {
+        return healthy.load() && probe_healthy.load() && circuit.load() != CircuitState::Open;
+    }
+};
+
+// Stable reference to a backend, handed out by choose_backend(). Stays valid
+// for as long as the caller holds it.
+using BackendHandle = std::shared_ptr<TargetInfo>;
+
+enum class LatencyKind {
+    Connect,     // TCP connect to the backend completed
+    FirstByte    // first response byte after the client's first request bytes
+};
+
+class SharedState;
+class BalancingStrategy;
+struct PreparedTable;
+
+// Tracks one proxied connection against its backend for as long as it is
+// held: counts it in active_connections and reports open/close and latency
+// samples to the active strategy.
+class BackendLease {
+public:
+    BackendLease() = default;
+    BackendLease(SharedState& state, BackendHandle backend);
+    ~BackendLease();
+
+    BackendLease(BackendLease&& other) noexcept = default;
+    BackendLease& operator=(BackendLease&& other) noexcept;
+    BackendLease(const BackendLease&) = delete;
+    BackendLease& operator=(const BackendLease&) = delete;
+
+    const BackendHandle& backend() const { return backend_; }
+    void report_latency(LatencyKind kind, std::chrono::microseconds latency);
+    void report_bytes(uint64_t to_backend, uint64_t from_backend);
+    // Passive health: the backend answered / reset or returned a gateway error
+    void report_success();
+    void report_failure();
+    void release();
+
+    // Totals for this lease, for the access log
+    std::chrono::steady_clock::time_point opened() const { return opened_; }
+    uint64_t bytes_to_backend() const { return bytes_to_backend_; }
+    uint64_t bytes_from_backend() const { return bytes_from_backend_; }
+
+private:
+    SharedState* state_ = nullptr;
+    BackendHandle backend_;
+    std::chrono::steady_clock::time_point opened_{};
+    uint64_t bytes_to_backend_ = 0;
+    uint64_t bytes_from_backend_ = 0;
+};
+
+// Per-connection selection input. Backends that already failed for this
+// connection are excluded so failover moves on to the next candidate.
+struct SelectionContext {
+    static constexpr size_t kMaxExcluded = 8;
+
+    uint64_t hash_key = 0;   // client affinity key for consistent_hash
+
+    std::array<const TargetInfo*, kMaxExcluded> excluded{};
+    size_t excluded_count = 0;
+
+    void exclude(const TargetInfo* t) {
+        if (excluded_count < kMaxExcluded) excluded[excluded_count++] = t;
+    }
+
+    bool allows(const TargetInfo* t) const {
+        for (size_t i = 0; i < excluded_count; ++i)
+            if (excluded[i] == t) return false;
+        return true;
+    }
+};
+
+struct StrategyOptions;
+
+// Passive outlier detection: after `consecutive_failures` failures in a row
+// a backend is ejected for base_ejection * 2^(n-1), n counting back-to-back
+// ejections, capped at max_ejection. When it expires the backend is
+// half-open: one trial connection at a time, success closes the circuit and
+// failure ejects it again.
+struct OutlierOptions {
+    uint32_t consecutive_failures = 5;   // 0 disables ejection
+    std::chrono::milliseconds base_ejection{30000};
+    std::chrono::milliseconds max_ejection{300000};
+    int max_ejection_percent = 50;       // of the configured targets, at least one
+};
+
+// A target as configured, before it is resolved into a TargetInfo
+struct TargetSpec {
+    std::string name;
+    std::string host;
+    int port = 0;
+    std::string cgroup_path;
+};
+
+// What set_targets() did, by target name
+struct TargetChanges {
+    std::vector<std::string> added;
+    std::vector<std::string> removed;
+    std::vector<std::string> replaced;   // same name, new address or cgroup
+
+    bool empty() const { return added.empty() && removed.empty() && replaced.empty(); }
 };
 
 class SharedState {
 public:
-    SharedState() = default;
+    SharedState();
+    ~SharedState();
+
+    // Add initial targets (called before monitor starts). The host is
+    // resolved here, once, so the connect path never hits the resolver.
+    void add_target(const std::string& name, const std::string& host, int port,
+                    const std::string& cgroup_path = "");
 
-    // Add initial targets (called before monitor starts)
-    void add_target(const std::string& name, const std::string& host, int port);
+    // Make the target set match `specs` (in that order) and publish it as one
+    // table swap. Unchanged targets keep their state; removed and replaced
+    // ones are only marked retired: sessions holding a handle finish
+    // normally, but choose_backend() stops returning them at once. Hosts are
+    // resolved before anything changes, so a failure leaves the set intact.
+    TargetChanges set_targets(const std::vector<TargetSpec>& specs);
 
     // Get a snapshot copy of targets (thread-safe)
     std::vector<TargetInfo> snapshot();
 
+    // Handles to the current targets, for the health checker
+    std::vector<BackendHandle> targets();
+
     // Update CPU% and health for target by name
     void update_target_stats(const std::string& name, double cpu_percent, bool healthy);
 
-    // Select backend based on configured strategy
-    std::optional<std::pair<std::string,int>> choose_backend();
+    // Update memory usage and CPU pressure for target by name
+    void update_target_resources(const std::string& name, uint64_t memory_bytes, double cpu_pressure);
 
-    // Set balancing strategy: "least_cpu" or "round_robin"
+    // Select backend based on configured strategy. Lock-free and
+    // allocation-free; returns nullptr when no allowed backend is healthy
+    // and below its connection limit.
+    BackendHandle choose_backend(const SelectionContext& ctx = {});
+
+    // Set balancing strategy by name (see make_strategy in strategy.h).
+    // Throws std::invalid_argument for unknown names.
     void set_strategy(const std::string& strategy);
+    void set_strategy(const std::string& strategy, const StrategyOptions& options);
+
+    // Smoothing factor for cpu_ewma, in (0, 1]; higher reacts faster
+    void set_ewma_alpha(double alpha);
+
+    void set_outlier_options(const OutlierOptions& options);
+
+    // Cap on active_connections + connecting per backend, 0 = none. A
+    // backend at its cap is skipped by choose_backend(); checked at pick
+    // time, so concurrent workers may overshoot it by a connection each.
+    void set_backend_connection_limit(int limit);
+
+    // Active health check verdict for a target (HealthChecker)
+    void set_probe_health(TargetInfo& target, bool healthy);
+
+    // Move ejected targets whose time is up to half-open. Called periodically.
+    void expire_ejections();
+
+    // Data-plane feedback, forwarded to the active strategy (lock-free).
+    // Normally called through BackendLease.
+    void report_connection_open(TargetInfo& target);
+    void report_connection_close(TargetInfo& target, std::chrono::microseconds duration);
+    void report_latency(TargetInfo& target, LatencyKind kind, std::chrono::microseconds latency);
+    // Metrics only: the strategy does not see these
+    void report_connect_failure(TargetInfo& target);   // also a passive failure
+    void report_bytes(TargetInfo& target, uint64_t to_backend, uint64_t from_backend);
+    // Passive outlier detection; lock-free unless the circuit changes state
+    void report_backend_success(TargetInfo& target);
+    void report_backend_failure(TargetInfo& target);
+
+    // Per-backend counters and histograms, summed over worker threads
+    BackendMetrics metrics(const TargetInfo& target) const { return metrics_.collect(target.id); }
 
 private:
-    std::mutex mtx_;
-    std::vector<TargetInfo> targets_;
-    std::string strategy_ = "least_cpu";
-    size_t rr_index_ = 0;
-};
+    // Immutable routing view published to the proxy threads. Rebuilt only
+    // when membership, health or strategy change; CPU% updates go straight
+    // to the TargetInfo atomics.
+    struct BackendTable {
+        std::vector<BackendHandle> healthy;
+        std::shared_ptr<BalancingStrategy> strategy;
+        std::unique_ptr<PreparedTable> prepared;
+        OutlierOptions outlier;
+        bool half_open = false;   // some backend in `healthy` only takes trials
+        int connection_limit = 0;
 
+        ~BackendTable();
+    };
+
+    // Caller must hold mtx_
+    uint32_t id_for(const std::string& name);   // under mtx_
+    void publish_table();
+    void eject(TargetInfo& target);
+
+    std::mutex mtx_;                      // serializes writers only
+    std::vector<BackendHandle> targets_;
+    std::shared_ptr<BalancingStrategy> strategy_;
+    double ewma_alpha_ = 0.3;
+    OutlierOptions outlier_;
+    int connection_limit_ = 0;
+    std::unordered_map<std::string, uint32_t> ids_;   // by name, kept across reloads
+    SnapshotPtr<BackendTable> table_;
+    MetricsRegistry metrics_;
+};
@@ -0,0 +1,83 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+// Read-mostly pointer with RCU-style reclamation.
+//
+// Readers pin the current object with read(): two atomic increments on a
+// per-thread-striped counter, no lock and no allocation. Writers install a
+// new object with publish(), which waits until every reader that could still
+// see the old object has left before deleting it. Writers must be serialized
+// by the caller.
+template <typename T>
+class SnapshotPtr {
+    struct alignas(64) ReaderSlot {
+        std::atomic<std::uint64_t> active[2] = {};
+    };
+    static constexpr std::size_t kSlots = 32;
+
+public:
+    class ReadGuard {
+    public:
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+        ~ReadGuard() { counter_.fetch_sub(1, std::memory_order_release); }
+
+        const T* get() const { return ptr_; }
+        const T* operator->() const { return ptr_; }
+        const T& operator*() const { return *ptr_; }
+        explicit operator bool() const { return ptr_ != nullptr; }
+
+    private:
+        friend class SnapshotPtr;
+        ReadGuard(std::atomic<std::uint64_t>& counter, const T* ptr)
+            : counter_(counter), ptr_(ptr) {}
+
+        std::atomic<std::uint64_t>& counter_;
+        const T* ptr_;
+    };
+
+    SnapshotPtr() = default;
+    SnapshotPtr(const SnapshotPtr&) = delete;
+    SnapshotPtr& operator=(const SnapshotPtr&) = delete;
+    ~SnapshotPtr() { delete current_.load(); }
+
+    ReadGuard read() const {
+        auto& slot = slots_[thread_slot()];
+        auto& counter = slot.active[epoch_.load(std::memory_order_acquire) & 1];
+        counter.fetch_add(1, std::memory_order_seq_cst);
+        return ReadGuard(counter, current_.load(std::memory_order_seq_cst));
+    }
+
+    void publish(std::unique_ptr<T> next) {
+        T* old = current_.exchange(next.release(), std::memory_order_seq_cst);
+        if (!old) return;
+        // Flip the epoch twice, draining each parity in turn: new readers go
+        // to the other counter, so the drain is bounded even under load.
+        for (int phase = 0; phase < 2; ++phase) {
+            unsigned parity = epoch_.fetch_add(1, std::memory_order_acq_rel) & 1;
+            while (readers(parity) != 0) std::this_thread::yield();
+        }
+        delete old;
+    }
+
+private:
+    std::uint64_t readers(unsigned parity) const {
+        std::uint64_t total = 0;
+        for (auto& slot : slots_) total += slot.active[parity].load(std::memory_order_acquire);
+        return total;
+    }
+
+    static std::size_t thread_slot() {
+        static std::atomic<std::size_t> next{0};
+        thread_local std::size_t slot = next.fetch_add(1, std::memory_order_relaxed) % kSlots;
+        return slot;
+    }
+
+    mutable std::array<ReaderSlot, kSlots> slots_{};
+    std::atomic<unsigned> epoch_{0};
+    std::atomic<T*> current_{nullptr};
+};
@@ -0,0 +1,298 @@
+#include "strategy.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <unordered_map>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+
+// Per-thread xorshift generator: cheap, lock-free randomness for selection
+static uint64_t next_random() {
+    thread_local uint64_t x = 0x9E3779B97F4A7C15ull
+        ^ reinterpret_cast<uintptr_t>(&x)
+        ^ static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return x;
+}
+
+// Lowest-cost allowed backend, scanning from a rotating start so ties don't
+// all land on the first entry.
+template <typename Cost>
+static const BackendHandle* pick_min(const std::vector<BackendHandle>& healthy,
+                                     const SelectionContext& ctx, size_t start, Cost cost) {
+    const BackendHandle* best = nullptr;
+    double best_cost = std::numeric_limits<double>::infinity();
+    for (size_t k = 0; k < healthy.size(); ++k) {
+        auto& t = healthy[(start + k) % healthy.size()];
+        if (!ctx.allows(t.get())) continue;
+        double c = cost(*t);
+        if (!best || c < best_cost) {
+            best = &t;
+            best_cost = c;
+        }
+    }
+    return best;
+}
+
+// 64-bit FNV-1a, seeded so one name can yield independent hashes
+static uint64_t hash_name(const std::string& name, uint64_t seed) {
+    uint64_t h = 0xcbf29ce484222325ull ^ seed;
+    for (unsigned char c : name) {
+        h ^= c;
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+static bool is_prime(uint32_t n) {
+    if (n < 2) return false;
+    for (uint32_t d = 2; static_cast<uint64_t>(d) * d <= n; ++d)
+        if (n % d == 0) return false;
+    return true;
+}
+
+// Power of two choices: compare two random backends and keep the cheaper.
+// Falls back to a full scan when failover has excluded either of them.
+template <typename Cost>
+static const BackendHandle* pick_p2c(const std::vector<BackendHandle>& healthy,
+                                     const SelectionContext& ctx, Cost cost) {
+    size_t n = healthy.size();
+    if (n == 1) return ctx.allows(healthy[0].get()) ? &healthy[0] : nullptr;
+    size_t i = next_random() % n;
+    size_t j = next_random() % (n - 1);
+    if (j >= i) ++j;
+    const auto& a = healthy[i];
+    const auto& b = healthy[j];
+    if (ctx.allows(a.get()) && ctx.allows(b.get()))
+        return cost(*a) <= cost(*b) ? &a : &b;
+    return pick_min(healthy, ctx, i, cost);
+}
+
+namespace {
+
+class RoundRobinStrategy : public BalancingStrategy {
+public:
+    const char* name() const override { return "round_robin"; }
+
+    const BackendHandle* pick(const std::vector<BackendHandle>& healthy, const PreparedTable*,
+                              const SelectionContext& ctx) override {
+        size_t start = index_.fetch_add(1, std::memory_order_relaxed);
+        for (size_t k = 0; k < healthy.size(); ++k) {
+            auto& t = healthy[(start + k) % healthy.size()];
+            if (ctx.allows(t.get())) return &t;
+        }
+        return nullptr;
+    }
+
+private:
+    std::atomic<size_t> index_{0};
+};
+
+class LeastCpuStrategy : public BalancingStrategy {
+public:
+    const char* name() const override { return "least_cpu"; }
+
+    const BackendHandle* pick(const std::vector<BackendHandle>& healthy, const PreparedTable*,
+                              const SelectionContext& ctx) override {
+        return pick_min(healthy, ctx, 0, [](const TargetInfo& t) {
+            return t.cpu_percent.load(std::memory_order_relaxed);
+        });
+    }
+};
+
+// EWMA CPU x in-flight connections with power of two choices. Unlike
+// least_cpu this does not send every new connection to the same backend
+// between two monitor samples.
+class AdaptiveStrategy : public BalancingStrategy {
+public:
+    const char* name() const override { return "adaptive"; }
+
+    const BackendHandle* pick(const std::vector<BackendHandle>& healthy, const PreparedTable*,
+                              const SelectionContext& ctx) override {
+        // The +1 terms keep an idle backend at 0% CPU from looking infinitely
+        // better than one with a single connection.
+        return pick_p2c(healthy, ctx, [](const TargetInfo& t) {
+            return (t.cpu_ewma.load(std::memory_order_relaxed) + 1.0)
+                 * (t.active_connections.load(std::memory_order_relaxed) + 1);
+        });
+    }
+};
+
+class LeastConnectionsStrategy : public BalancingStrategy {
+public:
+    const char* name() const override { return "least_connections"; }
+
+    const BackendHandle* pick(const std::vector<BackendHandle>& healthy, const PreparedTable*,
+                              const SelectionContext& ctx) override {
+        return pick_min(healthy, ctx, next_random() % healthy.size(), [](const TargetInfo& t) {
+            return static_cast<double>(t.active_connections.load(std::memory_order_relaxed));
+        });
+    }
+};
+
+// Peak-EWMA (as in Finagle/Linkerd): latency is tracked as an EWMA that
+// jumps straight up to any slower sample and decays back with time, and the
+// cost of a backend is that latency times its outstanding connections + 1.
+// Backends with no samples yet cost 0, so they get probed first.
+class PeakEwmaStrategy : public BalancingStrategy {
+public:
+    explicit PeakEwmaStrategy(std::chrono::milliseconds decay)
+        : tau_ns_(std::max<double>(1.0, std::chrono::duration<double, std::nano>(decay).count())) {}
+
+    const char* name() const override { return "peak_ewma"; }
+
+    const BackendHandle* pick(const std::vector<BackendHandle>& healthy, const PreparedTable*,
+                              const SelectionContext& ctx) override {
+        int64_t now = now_ns();
+        return pick_p2c(healthy, ctx, [this, now](const TargetInfo& t) {
+            return decayed(t, now) * (t.active_connections.load(std::memory_order_relaxed) + 1);
+        });
+    }
+
+    // Only first-byte samples count: connect times are orders of magnitude
+    // smaller and would make the estimate depend on which kind came last.
+    // Samples above the estimate replace it; lower ones blend in with a weight
+    // that grows with the time since the previous sample. Racing updates
+    // from two workers may drop one sample, which is fine for a smoothed
+    // estimate and keeps the hot path free of CAS loops.
+    void on_latency(TargetInfo& t, LatencyKind kind, std::chrono::microseconds sample) override {
+        if (kind != LatencyKind::FirstByte) return;
+        int64_t now = now_ns();
+        double rtt = static_cast<double>(sample.count());
+        double ewma = t.latency_ewma_us.load(std::memory_order_relaxed);
+        if (rtt > ewma) {
+            ewma = rtt;
+        } else {
+            double w = std::exp(-elapsed_ns(t, now) / tau_ns_);
+            ewma = ewma * w + rtt * (1.0 - w);
+        }
+        t.latency_ewma_us.store(ewma, std::memory_order_relaxed);
+        t.latency_stamp_ns.store(now, std::memory_order_relaxed);
+    }
+
+private:
+    static int64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static double elapsed_ns(const TargetInfo& t, int64_t now) {
+        int64_t elapsed = now - t.latency_stamp_ns.load(std::memory_order_relaxed);
+        return elapsed > 0 ? static_cast<double>(elapsed) : 0.0;
+    }
+
+    // Estimate decayed towards zero for the time since the last sample, so a
+    // backend penalised by one spike gets retried eventually.
+    double decayed(const TargetInfo& t, int64_t now) const {
+        double ewma = t.latency_ewma_us.load(std::memory_order_relaxed);
+        if (ewma <= 0.0) return ewma;
+        return ewma * std::exp(-elapsed_ns(t, now) / tau_ns_);
+    }
+
+    double tau_ns_;
+};
+
+// Maglev consistent hashing (Eisenbud et al., NSDI '16). Every backend owns
+// a permutation of the M lookup slots derived from its name; slots are handed
+// out round-robin by preference, so each backend gets ~M/N of them and a
+// health change only moves the slots of the backend that changed (plus a
+// small ripple). The lookup table is built in prepare() for each published
+// backend set and read with a single index at selection time.
+class MaglevStrategy : public BalancingStrategy {
+public:
+    explicit MaglevStrategy(uint32_t table_size) : size_(table_size) {}
+
+    const char* name() const override { return "consistent_hash"; }
+
+    std::unique_ptr<PreparedTable> prepare(const std::vector<BackendHandle>& healthy) override {
+        auto table = std::make_unique<Lookup>();
+        if (healthy.empty()) return table;
+
+        // Order by name so the table depends only on the set, not on config order
+        std::vector<uint32_t> order(healthy.size());
+        for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return healthy[a]->name < healthy[b]->name;
+        });
+
+        std::vector<const Permutation*> perms;
+        perms.reserve(order.size());
+        for (uint32_t i : order) perms.push_back(&permutation(healthy[i]->name));
+
+        table->slots.assign(size_, kEmpty);
+        std::vector<uint64_t> next(order.size(), 0);
+        uint32_t filled = 0;
+        while (true) {
+            for (size_t b = 0; b < order.size(); ++b) {
+                uint32_t slot;
+                do {
+                    slot = static_cast<uint32_t>((perms[b]->offset + next[b] * perms[b]->skip) % size_);
+                    ++next[b];
+                } while (table->slots[slot] != kEmpty);
+                table->slots[slot] = order[b];
+                if (++filled == size_) return table;
+            }
+        }
+    }
+
+    const BackendHandle* pick(const std::vector<BackendHandle>& healthy, const PreparedTable* prepared,
+                              const SelectionContext& ctx) override {
+        auto* table = static_cast<const Lookup*>(prepared);
+        if (!table || table->slots.empty()) return nullptr;
+        // Failover walks forward from the key's slot, which stays
+        // deterministic for a given client.
+        size_t start = ctx.hash_key % table->slots.size();
+        for (size_t k = 0; k < table->slots.size(); ++k) {
+            auto& t = healthy[table->slots[(start + k) % table->slots.size()]];
+            if (ctx.allows(t.get())) return &t;
+            if (k >= healthy.size() * 4) break;   // mostly-excluded set: scan instead
+        }
+        return pick_min(healthy, ctx, 0, [](const TargetInfo&) { return 0.0; });
+    }
+
+private:
+    static constexpr uint32_t kEmpty = UINT32_MAX;
+
+    struct Permutation {
+        uint64_t offset;
+        uint64_t skip;
+    };
+
+    struct Lookup : PreparedTable {
+        std::vector<uint32_t> slots;   // slot -> index into healthy
+    };
+
+    // Cached per name: prepare() only runs the fill loop on a rebuild
+    const Permutation& permutation(const std::string& name) {
+        auto it = permutations_.find(name);
+        if (it == permutations_.end()) {
+            Permutation p;
+            p.offset = hash_name(name, 0x5bd1e995) % size_;
+            p.skip = hash_name(name, 0x27d4eb2f) % (size_ - 1) + 1;
+            it = permutations_.emplace(name, p).first;
+        }
+        return it->second;
+    }
+
+    uint32_t size_;
+    std::unordered_map<std::string, Permutation> permutations_;   // prepare() only
+};
+
+} // namespace
+
+std::unique_ptr<BalancingStrategy> make_strategy(const std::string& name, const StrategyOptions& options) {
+    if (name == "round_robin") return std::make_unique<RoundRobinStrategy>();
+    if (name == "least_cpu") return std::make_unique<LeastCpuStrategy>();
+    if (name == "adaptive") return std::make_unique<AdaptiveStrategy>();
+    if (name == "least_connections") return std::make_unique<LeastConnectionsStrategy>();
+    if (name == "peak_ewma") return std::make_unique<PeakEwmaStrategy>(options.peak_ewma_decay);
+    if (name == "consistent_hash") {
+        // permutations only cover every slot when the size is prime
+        if (!is_prime(options.maglev_table_size)) throw std::invalid_argument("maglev_table_size must be prime");
+        return std::make_unique<MaglevStrategy>(options.maglev_table_size);
+    }
+    throw std::invalid_argument("unknown strategy: " + name);
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "shared_state.h"
+
+struct StrategyOptions {
+    // peak_ewma: how fast a latency peak decays back towards new samples
+    std::chrono::milliseconds peak_ewma_decay{10000};
+    // consistent_hash: Maglev lookup table size, must be prime
+    uint32_t maglev_table_size = 65537;
+};
+
+// Strategy-specific data precomputed for one published backend set
+struct PreparedTable {
+    virtual ~PreparedTable() = default;
+};
+
+// A load-balancing policy. pick() runs on every worker thread for every new
+// connection, concurrently and without locks, so implementations keep their
+// mutable state in atomics (their own, or the per-backend ones in
+// TargetInfo). The feedback hooks are called by the data plane through
+// BackendLease / SharedState and must be equally cheap.
+class BalancingStrategy {
+public:
+    virtual ~BalancingStrategy() = default;
+
+    virtual const char* name() const = 0;
+
+    // Called by the writer (under SharedState's lock) each time a new
+    // backend set is published; the result is published alongside it and
+    // handed back to pick(). Writer-side caches need no extra locking.
+    virtual std::unique_ptr<PreparedTable> prepare(const std::vector<BackendHandle>&) { return nullptr; }
+
+    // Choose one of `healthy` (never empty) that ctx allows, or nullptr.
+    virtual const BackendHandle* pick(const std::vector<BackendHandle>& healthy,
+                                      const PreparedTable* prepared,
+                                      const SelectionContext& ctx) = 0;
+
+    virtual void on_connection_open(TargetInfo&) {}
+    virtual void on_connection_close(TargetInfo&) {}
+    virtual void on_latency(TargetInfo&, LatencyKind, std::chrono::microseconds) {}
+};
+
+// "round_robin", "least_cpu", "adaptive", "least_connections", "peak_ewma",
+// "consistent_hash";
+// throws std::invalid_argument for anything else.
+std::unique_ptr<BalancingStrategy> make_strategy(const std::string& name,
+                                                 const StrategyOptions& options = {});
@@ -0,0 +1,82 @@
+#pragma once
+#include <linux/io_uring.h>
+#include <cstddef>
+#include <cstdint>
+
+// Minimal io_uring ring over the raw syscalls (liburing is not required):
+// maps the submission/completion rings, hands out SQEs, submits them in one
+// io_uring_enter per batch, and manages one provided-buffer ring that recv
+// SQEs pick their buffers from. Single-threaded: the ring belongs to the
+// thread that created it.
+class UringRing {
+public:
+    UringRing() = default;
+    ~UringRing();
+    UringRing(const UringRing&) = delete;
+    UringRing& operator=(const UringRing&) = delete;
+
+    // False (with errno set) if the kernel refuses io_uring
+    bool init(unsigned entries);
+
+    // A zeroed SQE, flushing the queue first if it is full
+    io_uring_sqe* get_sqe();
+
+    // Make room for `count` SQEs that must reach the kernel in the same
+    // submit (a linked chain): after true, the next `count` get_sqe() calls
+    // neither flush nor fail
+    bool reserve(unsigned count);
+
+    // Submit everything queued and wait for at least `wait_nr` completions.
+    // Returns a negative errno on failure.
+    int submit(unsigned wait_nr = 0);
+
+    // Visit each available completion, then release them all to the kernel
+    template <typename F>
+    unsigned for_each_cqe(F&& f) {
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        unsigned seen = 0;
+        for (; head != tail; ++head, ++seen) f(cqes_[head & cq_mask_]);
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        return seen;
+    }
+
+    // Register `count` (a power of two) buffers of `size` bytes as group
+    // `group`; false if the kernel lacks provided-buffer rings (< 5.19).
+    bool setup_buffers(uint16_t group, unsigned count, unsigned size);
+    char* buffer(uint16_t id) const { return buffers_ + static_cast<size_t>(id) * buffer_size_; }
+    unsigned buffer_size() const { return buffer_size_; }
+    uint16_t buffer_group() const { return buffer_group_; }
+    // Give a buffer picked by a recv back to the kernel
+    void recycle_buffer(uint16_t id);
+
+private:
+    int fd_ = -1;
+
+    void* sq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    void* cq_ring_ = nullptr;       // == sq_ring_ with IORING_FEAT_SINGLE_MMAP
+    size_t cq_ring_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned sq_local_tail_ = 0;    // SQEs handed out, published on submit()
+
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+
+    io_uring_buf_ring* buf_ring_ = nullptr;
+    size_t buf_ring_size_ = 0;
+    char* buffers_ = nullptr;
+    size_t buffers_size_ = 0;
+    unsigned buffer_count_ = 0;
+    unsigned buffer_size_ = 0;
+    uint16_t buffer_group_ = 0;
+    uint16_t buf_tail_ = 0;
+};
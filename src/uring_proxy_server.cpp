@@ -0,0 +1,472 @@
+#include "uring_proxy_server.h"
+#include "relay_session.h"
+#include "uring.h"
+#include "logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <system_error>
+#include <unistd.h>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr unsigned kRingEntries = 4096;
+constexpr unsigned kBufferCount = 1024;       // per worker; a power of two
+constexpr unsigned kBufferSize = 16 * 1024;   // as RelaySession
+constexpr uint16_t kBufferGroup = 0;
+constexpr long long kTickNs = 200'000'000;    // stop flag / accept re-arm check
+
+// What a completion is for, kept in the low bits of user_data next to the
+// Session pointer (8-byte aligned)
+enum Tag : uint64_t {
+    kAccept = 0,   // no session
+    kTick = 1,     // no session
+    kConnect = 2,
+    kConnectTimeout = 3,
+    kRecvUp = 4,
+    kRecvDown = 5,
+    kSendUp = 6,
+    kSendDown = 7
+};
+constexpr uint64_t kTagMask = 7;
+
+void set_no_delay(int fd) {
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+}  // namespace
+
+const std::string& io_uring_unavailable_reason() {
+    static const std::string reason = [] {
+        UringRing ring;
+        if (!ring.init(8)) return std::string("io_uring_setup: ") + std::strerror(errno);
+        // provided-buffer rings and multishot accept arrived together (5.19)
+        if (!ring.setup_buffers(kBufferGroup, 8, 4096)) return std::string("kernel older than 5.19");
+        return std::string();
+    }();
+    return reason;
+}
+
+struct UringProxyServer::Impl {
+    struct Direction {
+        int from = -1;
+        int to = -1;
+        bool upstream = true;
+        bool done = false;        // EOF passed on as a half-close
+        uint16_t buffer = 0;      // ring buffer held while its send is in flight
+        uint32_t length = 0;
+        uint32_t sent = 0;
+        // Set once the shared ring ran dry for this direction; from then on
+        // it relays through this buffer, like RelaySession
+        std::unique_ptr<char[]> own;
+    };
+
+    struct Session {
+        int client = -1;
+        int backend = -1;
+        Direction up;             // client -> backend
+        Direction down;           // backend -> client
+        SelectionContext selection;
+        BackendHandle connecting;   // target of the connect in flight
+        BackendLease lease;
+        AdmissionTicket ticket;
+        FirstByteTimer first_byte;
+        tcp::endpoint peer;         // client address, for the access log
+        __kernel_timespec connect_timeout{};   // read by the kernel until the connect completes
+        std::chrono::steady_clock::time_point connect_start{};
+        int attempts = 0;
+        int inflight = 0;           // SQEs whose completion has not arrived
+        bool closing = false;
+    };
+
+    Impl(short listen_port, SharedState& s, AdmissionController& a, const ProxyOptions& o)
+        : state(s), admission(a), options(o) {
+        // Same listener setup as ProxyServer: one SO_REUSEPORT socket per worker
+        listen_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0) throw std::system_error(errno, std::generic_category(), "socket");
+        int one = 1;
+        ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(listen_port));
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+            || ::listen(listen_fd, SOMAXCONN) < 0) {
+            int error = errno;
+            ::close(listen_fd);
+            throw std::system_error(error, std::generic_category(), "bind/listen");
+        }
+    }
+
+    ~Impl() {
+        // Ring last (declared first): nothing it completes is looked at again
+        for (Session* s : sessions) free_fds_and_delete(s);
+        if (listen_fd >= 0) ::close(listen_fd);
+    }
+
+    void run(const std::atomic<bool>& stop);
+
+    io_uring_sqe* sqe(uint64_t user_data) {
+        io_uring_sqe* e = ring.get_sqe();
+        if (e) e->user_data = user_data;
+        return e;
+    }
+    static uint64_t user_data(Session* s, Tag tag) { return reinterpret_cast<uint64_t>(s) | tag; }
+
+    void arm_accept();
+    void arm_tick();
+    void on_accept(int res, uint32_t flags);
+    void start_connect(Session* s);
+    void on_connect(Session* s, int res);
+    void arm_recv(Session* s, Direction& d);
+    void on_recv(Session* s, Direction& d, const io_uring_cqe& cqe);
+    void arm_send(Session* s, Direction& d);
+    void on_send(Session* s, Direction& d, int res);
+    void dispatch(const io_uring_cqe& cqe);
+    void close_session(Session* s);
+    void maybe_free(Session* s);
+    void free_fds_and_delete(Session* s);
+    void retry_starved();
+
+    UringRing ring;
+    SharedState& state;
+    AdmissionController& admission;
+    ProxyOptions options;
+    int listen_fd = -1;
+    bool accept_armed = false;
+    __kernel_timespec tick{0, kTickNs};
+    std::unordered_set<Session*> sessions;                 // owned
+    std::vector<std::pair<Session*, bool>> starved;        // recv found no free SQE; bool = upstream
+    std::vector<Session*> connect_starved;                  // no room for the connect chain yet
+};
+
+void UringProxyServer::Impl::arm_accept() {
+    io_uring_sqe* e = sqe(kAccept);
+    if (!e) return;   // retried on the next tick
+    e->opcode = IORING_OP_ACCEPT;
+    e->fd = listen_fd;
+    e->ioprio = IORING_ACCEPT_MULTISHOT;
+    e->accept_flags = SOCK_CLOEXEC;
+    accept_armed = true;
+}
+
+void UringProxyServer::Impl::arm_tick() {
+    io_uring_sqe* e = sqe(kTick);
+    if (!e) return;
+    e->opcode = IORING_OP_TIMEOUT;
+    e->addr = reinterpret_cast<uint64_t>(&tick);
+    e->len = 1;
+}
+
+void UringProxyServer::Impl::on_accept(int res, uint32_t flags) {
+    if (!(flags & IORING_CQE_F_MORE)) {
+        accept_armed = false;
+        // out of fds or memory: wait for the tick instead of failing in a loop
+        if (res != -EMFILE && res != -ENFILE && res != -ENOBUFS && res != -ENOMEM) arm_accept();
+    }
+    if (res < 0) {
+        LOG_ERROR("Accept failed: %s", std::strerror(-res));
+        return;
+    }
+
+    AdmissionTicket ticket = admission.admit();
+    if (!ticket) {
+        LOG_WARN("Connection limit reached, rejecting client");
+        ::close(res);
+        return;
+    }
+
+    auto* s = new Session();
+    s->client = res;
+    s->ticket = std::move(ticket);
+    tcp::endpoint peer;
+    socklen_t length = static_cast<socklen_t>(peer.capacity());
+    if (::getpeername(res, peer.data(), &length) == 0) {
+        peer.resize(length);
+        s->selection.hash_key = client_hash_key(peer, options.hash_key);
+        if (Logger::instance().access_enabled()) s->peer = peer;
+    }
+    set_no_delay(res);
+    sessions.insert(s);
+    start_connect(s);
+    maybe_free(s);
+}
+
+// Connect with a linked timeout; failover mirrors BackendConnector
+void UringProxyServer::Impl::start_connect(Session* s) {
+    // Both halves of the chain go to the kernel in one submit: a connect
+    // flushed on its own would run with no deadline. A full SQ is our
+    // problem, not the backend's, so nothing is picked until there is room.
+    if (!ring.reserve(2)) {
+        connect_starved.push_back(s);
+        return;
+    }
+    BackendHandle backend = state.choose_backend(s->selection);
+    if (!backend) {
+        LOG_ERROR("No healthy backend available.");
+        close_session(s);
+        return;
+    }
+    int fd = ::socket(backend->endpoint.protocol().family(), SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        LOG_ERROR("Backend socket failed: %s", std::strerror(errno));
+        close_session(s);
+        return;
+    }
+    s->backend = fd;
+    s->connecting = backend;
+    backend->connecting.fetch_add(1, std::memory_order_relaxed);   // counts against its limit
+    ++s->attempts;
+    s->connect_start = std::chrono::steady_clock::now();
+    auto timeout = options.connect.timeout;
+    s->connect_timeout.tv_sec = timeout.count() / 1000;
+    s->connect_timeout.tv_nsec = (timeout.count() % 1000) * 1000000;
+
+    io_uring_sqe* connect = sqe(user_data(s, kConnect));
+    connect->opcode = IORING_OP_CONNECT;
+    connect->fd = fd;
+    connect->addr = reinterpret_cast<uint64_t>(s->connecting->endpoint.data());
+    connect->off = s->connecting->endpoint.size();
+    connect->flags = IOSQE_IO_LINK;
+    io_uring_sqe* link = sqe(user_data(s, kConnectTimeout));
+    link->opcode = IORING_OP_LINK_TIMEOUT;
+    link->addr = reinterpret_cast<uint64_t>(&s->connect_timeout);
+    link->len = 1;
+    s->inflight += 2;
+}
+
+void UringProxyServer::Impl::on_connect(Session* s, int res) {
+    BackendHandle backend = std::move(s->connecting);
+    backend->connecting.fetch_sub(1, std::memory_order_relaxed);
+    if (s->closing) return;
+
+    if (res == 0) {
+        state.report_latency(*backend, LatencyKind::Connect,
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - s->connect_start));
+        LOG_DEBUG("Routing new connection → %s:%d", backend->host.c_str(), backend->port);
+        set_no_delay(s->backend);
+        s->lease = BackendLease(state, std::move(backend));
+        s->up.from = s->down.to = s->client;
+        s->up.to = s->down.from = s->backend;
+        s->down.upstream = false;
+        arm_recv(s, s->up);
+        arm_recv(s, s->down);
+        return;
+    }
+
+    // -ECANCELED: the linked timeout fired first
+    const char* reason = res == -ECANCELED ? "Connection timed out" : std::strerror(-res);
+    state.report_connect_failure(*backend);
+    LOG_WARN("Connect to %s:%d failed (%s)", backend->host.c_str(), backend->port, reason);
+    ::close(s->backend);
+    s->backend = -1;
+    if (s->attempts >= options.connect.max_attempts) {
+        LOG_ERROR("Failed to connect to backend (%s:%d): %s", backend->host.c_str(), backend->port, reason);
+        close_session(s);
+        return;
+    }
+    s->selection.exclude(backend.get());
+    start_connect(s);
+}
+
+void UringProxyServer::Impl::arm_recv(Session* s, Direction& d) {
+    io_uring_sqe* e = sqe(user_data(s, d.upstream ? kRecvUp : kRecvDown));
+    if (!e) {
+        starved.emplace_back(s, d.upstream);
+        return;
+    }
+    e->opcode = IORING_OP_RECV;
+    e->fd = d.from;
+    if (d.own) {
+        e->addr = reinterpret_cast<uint64_t>(d.own.get());
+        e->len = kBufferSize;
+    } else {
+        e->len = ring.buffer_size();
+        e->flags = IOSQE_BUFFER_SELECT;
+        e->buf_group = ring.buffer_group();
+    }
+    ++s->inflight;
+}
+
+void UringProxyServer::Impl::on_recv(Session* s, Direction& d, const io_uring_cqe& cqe) {
+    bool has_buffer = cqe.flags & IORING_CQE_F_BUFFER;
+    uint16_t buffer = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+    if (s->closing || cqe.res <= 0) {
+        if (has_buffer) ring.recycle_buffer(buffer);
+        if (s->closing) return;
+    }
+
+    int res = cqe.res;
+    if (res > 0) {
+        d.buffer = buffer;
+        d.length = static_cast<uint32_t>(res);
+        d.sent = 0;
+        if (d.upstream) {
+            s->first_byte.on_upstream_data();
+            s->lease.report_bytes(res, 0);
+        } else {
+            s->first_byte.on_downstream_data(s->lease);
+            s->lease.report_bytes(0, res);
+        }
+        arm_send(s, d);
+    } else if (res == 0) {
+        // EOF: pass the half-close on and wait for the other direction
+        d.done = true;
+        ::shutdown(d.to, SHUT_WR);
+        if (s->up.done && s->down.done) close_session(s);
+    } else if (res == -ENOBUFS) {
+        // Every ring buffer is waiting on a slow peer: rather than wait for
+        // one to come back, this direction gets its own
+        d.own = std::make_unique<char[]>(kBufferSize);
+        arm_recv(s, d);
+    } else {
+        if (d.from == s->backend) s->lease.report_failure();   // reset by the backend
+        close_session(s);
+    }
+}
+
+void UringProxyServer::Impl::arm_send(Session* s, Direction& d) {
+    io_uring_sqe* e = sqe(user_data(s, d.upstream ? kSendUp : kSendDown));
+    if (!e) {
+        if (!d.own) ring.recycle_buffer(d.buffer);
+        close_session(s);
+        return;
+    }
+    e->opcode = IORING_OP_SEND;
+    e->fd = d.to;
+    e->addr = reinterpret_cast<uint64_t>((d.own ? d.own.get() : ring.buffer(d.buffer)) + d.sent);
+    e->len = d.length - d.sent;
+    e->msg_flags = MSG_NOSIGNAL;
+    ++s->inflight;
+}
+
+void UringProxyServer::Impl::on_send(Session* s, Direction& d, int res) {
+    if (!s->closing && res > 0 && d.sent + res < d.length) {
+        d.sent += res;
+        arm_send(s, d);   // short write: send the rest from the same buffer
+        return;
+    }
+    if (!d.own) ring.recycle_buffer(d.buffer);
+    if (s->closing) return;
+    if (res < 0) {
+        if (d.to == s->backend) s->lease.report_failure();
+        close_session(s);
+        return;
+    }
+    arm_recv(s, d);
+}
+
+void UringProxyServer::Impl::dispatch(const io_uring_cqe& cqe) {
+    auto tag = static_cast<Tag>(cqe.user_data & kTagMask);
+    if (tag == kAccept) {
+        on_accept(cqe.res, cqe.flags);
+        return;
+    }
+    if (tag == kTick) {
+        arm_tick();
+        if (!accept_armed) arm_accept();
+        return;
+    }
+
+    auto* s = reinterpret_cast<Session*>(cqe.user_data & ~kTagMask);
+    --s->inflight;
+    switch (tag) {
+    case kConnect: on_connect(s, cqe.res); break;
+    case kConnectTimeout:
+        // -ETIME fired, -ECANCELED connect finished first, -EALREADY raced it;
+        // anything else means the connect was not bounded
+        if (cqe.res != -ETIME && cqe.res != -ECANCELED && cqe.res != -EALREADY)
+            LOG_WARN("Connect timeout not armed: %s", std::strerror(-cqe.res));
+        break;
+    case kRecvUp: on_recv(s, s->up, cqe); break;
+    case kRecvDown: on_recv(s, s->down, cqe); break;
+    case kSendUp: on_send(s, s->up, cqe.res); break;
+    case kSendDown: on_send(s, s->down, cqe.res); break;
+    default: break;
+    }
+    maybe_free(s);
+}
+
+// Shut both sockets down so every pending recv/send completes; the session
+// is freed once the last completion is in
+void UringProxyServer::Impl::close_session(Session* s) {
+    if (s->closing) return;
+    s->closing = true;
+    log_session(s->peer, s->lease);
+    ::shutdown(s->client, SHUT_RDWR);
+    if (s->backend >= 0) ::shutdown(s->backend, SHUT_RDWR);
+    s->lease.release();
+    s->ticket.release();
+}
+
+void UringProxyServer::Impl::maybe_free(Session* s) {
+    if (!s->closing || s->inflight > 0) return;
+    starved.erase(std::remove_if(starved.begin(), starved.end(),
+                                 [s](const std::pair<Session*, bool>& p) { return p.first == s; }),
+                  starved.end());
+    connect_starved.erase(std::remove(connect_starved.begin(), connect_starved.end(), s), connect_starved.end());
+    sessions.erase(s);
+    free_fds_and_delete(s);
+}
+
+void UringProxyServer::Impl::free_fds_and_delete(Session* s) {
+    if (s->client >= 0) ::close(s->client);
+    if (s->backend >= 0) ::close(s->backend);
+    delete s;
+}
+
+void UringProxyServer::Impl::retry_starved() {
+    std::vector<Session*> connects;
+    connects.swap(connect_starved);
+    for (Session* s : connects) {
+        if (!s->closing) start_connect(s);
+        maybe_free(s);   // start_connect may have given up on it
+    }
+    std::vector<std::pair<Session*, bool>> retry;
+    retry.swap(starved);
+    for (auto& [s, upstream] : retry) {
+        if (!s->closing) arm_recv(s, upstream ? s->up : s->down);
+    }
+}
+
+void UringProxyServer::Impl::run(const std::atomic<bool>& stop) {
+    // Created here: with SINGLE_ISSUER the ring belongs to this thread
+    if (!ring.init(kRingEntries) || !ring.setup_buffers(kBufferGroup, kBufferCount, kBufferSize)) {
+        LOG_ERROR("io_uring worker failed to start: %s", std::strerror(errno));
+        ::close(listen_fd);   // leave the port to the other workers
+        listen_fd = -1;
+        return;
+    }
+    arm_accept();
+    arm_tick();
+    while (!stop.load(std::memory_order_relaxed)) {
+        // one syscall: submit what the last batch queued, wait for the next
+        int ret = ring.submit(1);
+        if (ret < 0 && ret != -ETIME && ret != -EBUSY && ret != -EAGAIN) {
+            LOG_ERROR("io_uring_enter failed: %s", std::strerror(-ret));
+            break;
+        }
+        ring.for_each_cqe([this](const io_uring_cqe& cqe) { dispatch(cqe); });
+        if (!starved.empty() || !connect_starved.empty()) retry_starved();   // the submit above freed SQ slots
+    }
+}
+
+UringProxyServer::UringProxyServer(short listen_port, SharedState& state, AdmissionController& admission,
+                                   const ProxyOptions& options)
+    : impl_(std::make_unique<Impl>(listen_port, state, admission, options)) {}
+
+UringProxyServer::~UringProxyServer() = default;
+
+void UringProxyServer::run(const std::atomic<bool>& stop) {
+    impl_->run(stop);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "proxy_server.h"
+#include "admission.h"
+#include "shared_state.h"
+
+// Empty if this kernel can run UringProxyServer, else why not (probed once)
+const std::string& io_uring_unavailable_reason();
+
+// tcp-mode worker on io_uring instead of the asio reactor. Same role and
+// inputs as ProxyServer (one per worker thread, each with its own
+// SO_REUSEPORT listener) but the worker thread drives its own ring:
+//
+//  - a single multishot accept keeps delivering clients without re-arming
+//  - recv SQEs pick buffers from a provided-buffer ring, so idle
+//    connections pin no memory, and a buffer goes back to the ring once its
+//    send completes. A direction holds at most one; if slow peers have
+//    pinned them all, the direction falls back to a buffer of its own
+//  - backend connects are linked to a LINK_TIMEOUT (connect_timeout_ms)
+//  - every SQE queued while handling a batch of completions goes to the
+//    kernel in the one io_uring_enter that also waits for the next batch
+//
+// A direction only receives again after its send completed, as in
+// RelaySession, so backpressure works the same way. Selection, failover,
+// leases, passive health and admission go through the same SharedState and
+// AdmissionController calls as the asio path; clients that find no backend
+// are closed rather than queued.
+class UringProxyServer {
+public:
+    UringProxyServer(short listen_port, SharedState& state, AdmissionController& admission,
+                     const ProxyOptions& options);
+    ~UringProxyServer();
+
+    // The worker loop; returns once `stop` is set (checked every 200ms)
+    void run(const std::atomic<bool>& stop);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};